@@ -0,0 +1,355 @@
+#include "shell.h"
+#include <math.h>
+
+/* bench: repeated execution with statistics (hyperfine-style)
+ *
+ *   bench [-n RUNS] [-w WARMUP] [--show-output] [--json FILE] cmd ... [::: cmd ...]
+ *
+ * Each command (commands are separated by ":::") is run through
+ * process_line() WARMUP times untimed, then RUNS times timed. The parser
+ * leaves bench lines unsplit and keeps each word as written, so a quoted
+ * command such as 'ls | wc -l' or 'cd /tmp; ls' reaches process_line()
+ * exactly as typed, pipes and lists included. Wall time
+ * comes from the monotonic clock; user and sys CPU from the RUSAGE_SELF
+ * and RUSAGE_CHILDREN deltas, so builtins and external commands are
+ * measured the same way. Output is discarded unless --show-output is
+ * given. With several commands a relative comparison against the fastest
+ * is printed. --json writes the results to FILE ("-" for stdout) instead
+ * of the table.
+ */
+
+#define BENCH_DEFAULT_RUNS 10
+#define BENCH_DEFAULT_WARMUP 1
+#define BENCH_MAX_COMMANDS 16
+
+typedef struct BenchSummary {
+    char *command;      // Command line as run
+    int runs;
+    int failed;         // Runs with a non-zero status
+    int outliers;       // Samples outside 1.5 IQR of the quartiles
+    double mean;
+    double stddev;
+    double min;
+    double max;
+    double median;
+    double p95;
+    double p99;
+    double user;        // Mean user CPU per run
+    double sys;         // Mean sys CPU per run
+} BenchSummary;
+
+static double cpu_seconds(const struct timeval *tv) {
+    return tv->tv_sec + tv->tv_usec / 1e6;
+}
+
+// Sum of shell and reaped-children CPU, split into user and sys.
+static void cpu_now(double *user, double *sys) {
+    struct rusage self, children;
+    getrusage(RUSAGE_SELF, &self);
+    getrusage(RUSAGE_CHILDREN, &children);
+    *user = cpu_seconds(&self.ru_utime) + cpu_seconds(&children.ru_utime);
+    *sys = cpu_seconds(&self.ru_stime) + cpu_seconds(&children.ru_stime);
+}
+
+/* The parser hands bench its words exactly as written. A word that is one
+ * quoted string ('ls | wc -l') is unquoted and nothing else; other words
+ * are returned as they are. Returns a new string.
+ */
+static char *unquote(const char *word) {
+    size_t len = strlen(word);
+    char quote = word[0];
+    if (len >= 2 && (quote == '"' || quote == '\'')) {
+        size_t i = 1;
+        while (i < len && word[i] != quote) {
+            if (word[i] == '\\' && quote == '"' && i + 1 < len) i++;
+            i++;
+        }
+        if (i == len - 1) {
+            return strndup(word + 1, len - 2);
+        }
+    }
+    return strdup(word);
+}
+
+/* Command line for words [start, end): a single word is unquoted, several
+ * words are joined with spaces and keep their quoting for process_line().
+ */
+static char *command_text(char **args, int start, int end) {
+    if (end - start == 1) {
+        char *line = unquote(args[start]);
+        if (!line) {
+            print_error();
+            exit(1);
+        }
+        return line;
+    }
+    size_t len = 1;
+    for (int i = start; i < end; i++) {
+        len += strlen(args[i]) + 1;
+    }
+    char *line = malloc(len);
+    if (!line) {
+        print_error();
+        exit(1);
+    }
+    line[0] = '\0';
+    for (int i = start; i < end; i++) {
+        if (i > start) strcat(line, " ");
+        strcat(line, args[i]);
+    }
+    return line;
+}
+
+// Point stdout/stderr at /dev/null while benchmarking; returns saved fds.
+static void silence_output(int saved[2]) {
+    fflush(stdout);
+    fflush(stderr);
+    saved[0] = fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC, 0);
+    saved[1] = fcntl(STDERR_FILENO, F_DUPFD_CLOEXEC, 0);
+    int devnull = open("/dev/null", O_WRONLY | O_CLOEXEC);
+    if (devnull >= 0) {
+        dup2(devnull, STDOUT_FILENO);
+        dup2(devnull, STDERR_FILENO);
+        close(devnull);
+    }
+}
+
+static void restore_output(int saved[2]) {
+    fflush(stdout);
+    fflush(stderr);
+    if (saved[0] >= 0) {
+        dup2(saved[0], STDOUT_FILENO);
+        close(saved[0]);
+    }
+    if (saved[1] >= 0) {
+        dup2(saved[1], STDERR_FILENO);
+        close(saved[1]);
+    }
+}
+
+static void run_once(const char *command) {
+    char *line = strdup(command);
+    if (!line) {
+        print_error();
+        exit(1);
+    }
+    process_line(line);
+    free(line);
+}
+
+static void bench_command(BenchSummary *sum, int runs, int warmup, int show_output) {
+    double *wall = malloc(sizeof(double) * runs);
+    if (!wall) {
+        print_error();
+        exit(1);
+    }
+    int saved[2] = {-1, -1};
+    if (!show_output) {
+        silence_output(saved);
+    }
+
+    for (int i = 0; i < warmup; i++) {
+        run_once(sum->command);
+    }
+
+    double user_total = 0, sys_total = 0, total = 0;
+    sum->failed = 0;
+    for (int i = 0; i < runs; i++) {
+        double u0, s0, u1, s1;
+        cpu_now(&u0, &s0);
+        double start = now_seconds();
+        run_once(sum->command);
+        wall[i] = now_seconds() - start;
+        cpu_now(&u1, &s1);
+        user_total += u1 - u0;
+        sys_total += s1 - s0;
+        total += wall[i];
+        if (g_last_status != 0) {
+            sum->failed++;
+        }
+    }
+
+    if (!show_output) {
+        restore_output(saved);
+    }
+
+    qsort(wall, runs, sizeof(double), compare_doubles);
+    sum->runs = runs;
+    sum->mean = total / runs;
+    double var = 0;
+    for (int i = 0; i < runs; i++) {
+        var += (wall[i] - sum->mean) * (wall[i] - sum->mean);
+    }
+    sum->stddev = runs > 1 ? sqrt(var / (runs - 1)) : 0;
+    sum->min = wall[0];
+    sum->max = wall[runs - 1];
+    sum->median = percentile(wall, runs, 50);
+    sum->p95 = percentile(wall, runs, 95);
+    sum->p99 = percentile(wall, runs, 99);
+    sum->user = user_total / runs;
+    sum->sys = sys_total / runs;
+
+    double q1 = percentile(wall, runs, 25);
+    double q3 = percentile(wall, runs, 75);
+    double iqr = q3 - q1;
+    sum->outliers = 0;
+    for (int i = 0; i < runs; i++) {
+        if (wall[i] < q1 - 1.5 * iqr || wall[i] > q3 + 1.5 * iqr) {
+            sum->outliers++;
+        }
+    }
+    free(wall);
+}
+
+static void print_summary(const BenchSummary *sum) {
+    printf("Benchmark: %s\n", sum->command);
+    printf("  Time (mean ± σ):   %9.3f ms ± %7.3f ms    [User: %.3f ms, System: %.3f ms]\n",
+           sum->mean * 1e3, sum->stddev * 1e3, sum->user * 1e3, sum->sys * 1e3);
+    printf("  Range (min … max): %9.3f ms … %7.3f ms    %d runs\n",
+           sum->min * 1e3, sum->max * 1e3, sum->runs);
+    printf("  Median %.3f ms, p95 %.3f ms, p99 %.3f ms\n",
+           sum->median * 1e3, sum->p95 * 1e3, sum->p99 * 1e3);
+    if (sum->outliers > 0) {
+        printf("  Warning: %d statistical outlier(s) detected; consider more warmup runs.\n",
+               sum->outliers);
+    }
+    if (sum->failed > 0) {
+        printf("  Warning: %d run(s) exited with a non-zero status.\n", sum->failed);
+    }
+    printf("\n");
+}
+
+static void print_comparison(const BenchSummary *sums, int n) {
+    int fastest = 0;
+    for (int i = 1; i < n; i++) {
+        if (sums[i].mean < sums[fastest].mean) fastest = i;
+    }
+    printf("Summary\n  %s ran\n", sums[fastest].command);
+    for (int i = 0; i < n; i++) {
+        if (i == fastest) continue;
+        double ratio = sums[i].mean / sums[fastest].mean;
+        // Relative error of a ratio: combine both relative standard deviations.
+        double rel_a = sums[i].mean > 0 ? sums[i].stddev / sums[i].mean : 0;
+        double rel_b = sums[fastest].mean > 0 ? sums[fastest].stddev / sums[fastest].mean : 0;
+        double err = ratio * sqrt(rel_a * rel_a + rel_b * rel_b);
+        printf("    %6.2f ± %.2f times faster than %s\n", ratio, err, sums[i].command);
+    }
+}
+
+static void write_json_string(FILE *out, const char *s) {
+    fputc('"', out);
+    for (; *s; s++) {
+        unsigned char c = (unsigned char)*s;
+        if (c == '"' || c == '\\') {
+            fputc('\\', out);
+            fputc(c, out);
+        } else if (c == '\n') {
+            fputs("\\n", out);
+        } else if (c == '\t') {
+            fputs("\\t", out);
+        } else if (c < 0x20 || c == 0x7f) {
+            fprintf(out, "\\u%04x", c);
+        } else {
+            fputc(c, out);
+        }
+    }
+    fputc('"', out);
+}
+
+static int write_json(const char *path, const BenchSummary *sums, int n) {
+    FILE *out = strcmp(path, "-") == 0 ? stdout : fopen(path, "we");
+    if (!out) {
+        return -1;
+    }
+    fprintf(out, "{\"results\":[");
+    for (int i = 0; i < n; i++) {
+        const BenchSummary *s = &sums[i];
+        fprintf(out, "%s{\"command\":", i ? "," : "");
+        write_json_string(out, s->command);
+        fprintf(out, ",\"runs\":%d,\"failed\":%d,\"outliers\":%d,\"mean\":%.9f,"
+                     "\"stddev\":%.9f,\"median\":%.9f,\"min\":%.9f,\"max\":%.9f,"
+                     "\"p95\":%.9f,\"p99\":%.9f,\"user\":%.9f,\"system\":%.9f}",
+                s->runs, s->failed, s->outliers, s->mean, s->stddev, s->median,
+                s->min, s->max, s->p95, s->p99, s->user, s->sys);
+    }
+    fprintf(out, "]}\n");
+    if (out == stdout) {
+        fflush(stdout);
+        return 0;
+    }
+    return fclose(out) == 0 ? 0 : -1;
+}
+
+void builtin_bench(char **args) {
+    int runs = BENCH_DEFAULT_RUNS;
+    int warmup = BENCH_DEFAULT_WARMUP;
+    int show_output = 0;
+    char *json_path = NULL;
+    int i = 1;
+
+    // Options
+    while (args[i] && args[i][0] == '-') {
+        if (strcmp(args[i], "-n") == 0 && args[i + 1]) {
+            runs = atoi(args[++i]);
+        } else if (strcmp(args[i], "-w") == 0 && args[i + 1]) {
+            warmup = atoi(args[++i]);
+        } else if (strcmp(args[i], "--show-output") == 0) {
+            show_output = 1;
+        } else if (strcmp(args[i], "--json") == 0 && args[i + 1]) {
+            free(json_path);
+            json_path = unquote(args[++i]);
+        } else {
+            break;
+        }
+        i++;
+    }
+    if (runs <= 0 || warmup < 0 || !args[i]) {
+        print_error();
+        free(json_path);
+        return;
+    }
+
+    // Commands, separated by ":::"
+    BenchSummary sums[BENCH_MAX_COMMANDS];
+    int count = 0;
+    while (args[i] && count < BENCH_MAX_COMMANDS) {
+        int start = i;
+        while (args[i] && strcmp(args[i], ":::") != 0) {
+            i++;
+        }
+        if (i > start) {
+            memset(&sums[count], 0, sizeof(BenchSummary));
+            sums[count++].command = command_text(args, start, i);
+        }
+        if (args[i]) i++;  // Skip the separator
+    }
+    if (count == 0) {
+        print_error();
+        free(json_path);
+        return;
+    }
+
+    for (int c = 0; c < count; c++) {
+        bench_command(&sums[c], runs, warmup, show_output);
+        if (!json_path) {
+            print_summary(&sums[c]);
+        }
+    }
+
+    if (json_path) {
+        if (write_json(json_path, sums, count) < 0) {
+            print_error();
+        }
+    } else if (count > 1) {
+        print_comparison(sums, count);
+    }
+    fflush(stdout);
+
+    int any_failed = 0;
+    for (int c = 0; c < count; c++) {
+        any_failed |= sums[c].failed > 0;
+        free(sums[c].command);
+    }
+    free(json_path);
+    g_last_status = any_failed ? 1 : 0;
+}
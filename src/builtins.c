@@ -1,16 +1,187 @@
 #include "shell.h"
 #include <signal.h>
 #include <stdlib.h>
+#include <sys/stat.h>
+
+/* test / [ for loop and if conditions, evaluated without forking.
+ * Supports -e -f -d -r -w -x -s FILE, -z/-n STR, STR = != STR,
+ * INT -eq -ne -lt -le -gt -ge INT and a leading "!". Returns 0 for true,
+ * 1 for false and 2 for a malformed expression.
+ */
+static int eval_test(char **args, int argc) {
+    if (argc > 0 && strcmp(args[0], "!") == 0) {
+        int rc = eval_test(args + 1, argc - 1);
+        return rc == 2 ? 2 : !rc;
+    }
+    if (argc == 0) return 1;
+    if (argc == 1) return args[0][0] ? 0 : 1;
+    if (argc == 2) {
+        const char *op = args[0], *arg = args[1];
+        struct stat st;
+        if (strcmp(op, "-z") == 0) return arg[0] ? 1 : 0;
+        if (strcmp(op, "-n") == 0) return arg[0] ? 0 : 1;
+        if (strcmp(op, "-r") == 0) return access(arg, R_OK) == 0 ? 0 : 1;
+        if (strcmp(op, "-w") == 0) return access(arg, W_OK) == 0 ? 0 : 1;
+        if (strcmp(op, "-x") == 0) return access(arg, X_OK) == 0 ? 0 : 1;
+        if (op[0] != '-' || !op[1] || op[2]) return 2;
+        if (stat(arg, &st) != 0) return strchr("efds", op[1]) ? 1 : 2;
+        switch (op[1]) {
+        case 'e': return 0;
+        case 'f': return S_ISREG(st.st_mode) ? 0 : 1;
+        case 'd': return S_ISDIR(st.st_mode) ? 0 : 1;
+        case 's': return st.st_size > 0 ? 0 : 1;
+        default: return 2;
+        }
+    }
+    if (argc == 3) {
+        const char *a = args[0], *op = args[1], *b = args[2];
+        if (strcmp(op, "=") == 0 || strcmp(op, "==") == 0) return strcmp(a, b) == 0 ? 0 : 1;
+        if (strcmp(op, "!=") == 0) return strcmp(a, b) != 0 ? 0 : 1;
+        char *end_a, *end_b;
+        long x = strtol(a, &end_a, 10), y = strtol(b, &end_b, 10);
+        if (!a[0] || *end_a || !b[0] || *end_b) return 2;
+        if (strcmp(op, "-eq") == 0) return x == y ? 0 : 1;
+        if (strcmp(op, "-ne") == 0) return x != y ? 0 : 1;
+        if (strcmp(op, "-lt") == 0) return x < y ? 0 : 1;
+        if (strcmp(op, "-le") == 0) return x <= y ? 0 : 1;
+        if (strcmp(op, "-gt") == 0) return x > y ? 0 : 1;
+        if (strcmp(op, "-ge") == 0) return x >= y ? 0 : 1;
+    }
+    return 2;
+}
+
+static void builtin_test(char **args) {
+    int argc = 0;
+    while (args[argc + 1]) argc++;
+    if (strcmp(args[0], "[") == 0) {
+        if (argc == 0 || strcmp(args[argc], "]") != 0) {
+            print_error();
+            g_last_status = 2;
+            return;
+        }
+        argc--;
+    }
+    g_last_status = eval_test(args + 1, argc);
+    if (g_last_status == 2) {
+        print_error();
+        g_last_status = 2;
+    }
+}
+
+static void builtin_exit(char **args) {
+    if (args[1] != NULL) {
+        print_error();
+    } else {
+        exit(0);
+    }
+}
+
+static void builtin_path(char **args) {
+    DEBUG_PRINT("Executing path command\n");
+    
+    // Count new paths
+    int new_count = 0;
+    while (args[new_count + 1] != NULL) {
+        new_count++;
+    }
+    
+    // Free old paths
+    for (int i = 0; i < g_path_count; i++) {
+        mem_free(MEM_PATH, g_path[i]);
+    }
+    mem_free(MEM_PATH, g_path);
+    
+    // Allocate and copy new paths
+    g_path_count = new_count;
+    if (new_count > 0) {
+        g_path = mem_malloc(MEM_PATH, sizeof(char*) * new_count);
+        
+        for (int i = 0; i < new_count; i++) {
+            g_path[i] = mem_strdup(MEM_PATH, args[i + 1]);
+            DEBUG_PRINTF("Added path: %s\n", g_path[i]);
+        }
+    } else {
+        g_path = NULL;
+    }
+    lookup_cache_invalidate();
+    DEBUG_PRINTF("Path updated, new count: %d\n", g_path_count);
+}
+
+static void builtin_history(char **args) {
+    (void)args;
+    print_history();
+}
+
+static void builtin_kill(char **args) {
+    if (args[1] == NULL || args[2] != NULL) {
+        print_error();
+    } else {
+        int pid = args[1][0] == '%' ? jobs_pid(args[1]) : atoi(args[1]);
+        if (pid <= 0) {
+            print_error();
+        } else {
+            if (kill(pid, SIGTERM) != 0) {
+                print_error();
+            }
+        }
+    }
+}
+
+static void builtin_true(char **args) {
+    (void)args;
+    g_last_status = 0;
+}
+
+static void builtin_false(char **args) {
+    (void)args;
+    g_last_status = 1;
+}
+
+// Core builtins; to add one, write its handler and list it here.
+static const struct {
+    const char *name;
+    BuiltinFn fn;
+} CORE_BUILTINS[] = {
+    {"exit", builtin_exit},
+    {"cd", builtin_cd},
+    {"path", builtin_path},
+    {"pwd", builtin_pwd},
+    {"pushd", builtin_pushd},
+    {"popd", builtin_popd},
+    {"dirs", builtin_dirs},
+    {"history", builtin_history},
+    {"kill", builtin_kill},
+    {"parallel", builtin_parallel},
+    {"stats", builtin_stats},
+    {"times", builtin_stats},
+    {"mem", builtin_mem},
+    {"trace", builtin_trace},
+    {"bench", builtin_bench},
+    {"true", builtin_true},
+    {":", builtin_true},
+    {"false", builtin_false},
+    {"test", builtin_test},
+    {"[", builtin_test},
+    {"enable", builtin_enable},
+    {"jobs", builtin_jobs},
+    {"coproc", builtin_coproc},
+};
+
+static const BuiltinEntry *find_builtin(const char *name) {
+    static int registered = 0;
+    if (!registered) {
+        for (size_t i = 0; i < sizeof(CORE_BUILTINS) / sizeof(CORE_BUILTINS[0]); i++) {
+            builtin_register(CORE_BUILTINS[i].name, CORE_BUILTINS[i].fn);
+        }
+        registered = 1;
+    }
+    return builtin_find(name);
+}
 
 int is_builtin(char **args) {
     if (!args || !args[0]) return 1;  // treat empty command as built-in
     
-    if (strcmp(args[0], "exit") == 0 ||
-        strcmp(args[0], "cd") == 0 ||
-        strcmp(args[0], "path") == 0 ||
-        strcmp(args[0], "pwd") == 0 ||
-        strcmp(args[0], "history") == 0 ||
-        strcmp(args[0], "kill") == 0)
+    if (find_builtin(args[0]))
         return 1;
     
     // Check for history re-execution command (e.g., !2)
@@ -23,83 +194,9 @@ int is_builtin(char **args) {
 void execute_builtin(char **args) {
     if (!args || !args[0]) return;
 
-    if (strcmp(args[0], "exit") == 0) {
-        if (args[1] != NULL) {
-            print_error();
-        } else {
-            exit(0);
-        }
-    } else if (strcmp(args[0], "cd") == 0) {
-        if (args[1] == NULL || args[2] != NULL) {
-            print_error();
-        } else {
-            if (chdir(args[1]) != 0) {
-                print_error();
-            }
-        }
-    } else if (strcmp(args[0], "path") == 0) {
-        DEBUG_PRINT("Executing path command\n");
-        
-        // Count new paths
-        int new_count = 0;
-        while (args[new_count + 1] != NULL) {
-            new_count++;
-        }
-        
-        // Free old paths
-        for (int i = 0; i < g_path_count; i++) {
-            free(g_path[i]);
-        }
-        free(g_path);
-        
-        // Allocate and copy new paths
-        g_path_count = new_count;
-        if (new_count > 0) {
-            g_path = malloc(sizeof(char*) * new_count);
-            if (!g_path) {
-                print_error();
-                exit(1);
-            }
-            
-            for (int i = 0; i < new_count; i++) {
-                g_path[i] = strdup(args[i + 1]);
-                if (!g_path[i]) {
-                    // Cleanup on error
-                    for (int j = 0; j < i; j++) {
-                        free(g_path[j]);
-                    }
-                    free(g_path);
-                    print_error();
-                    exit(1);
-                }
-                DEBUG_PRINTF("Added path: %s\n", g_path[i]);
-            }
-        } else {
-            g_path = NULL;
-        }
-        DEBUG_PRINTF("Path updated, new count: %d\n", g_path_count);
-    } else if (strcmp(args[0], "pwd") == 0) {
-        char cwd[1024];
-        if (getcwd(cwd, sizeof(cwd)) == NULL) {
-            print_error();
-        } else {
-            printf("%s\n", cwd);
-        }
-    } else if (strcmp(args[0], "history") == 0) {
-        print_history();
-    } else if (strcmp(args[0], "kill") == 0) {
-        if (args[1] == NULL || args[2] != NULL) {
-            print_error();
-        } else {
-            int pid = atoi(args[1]);
-            if (pid <= 0) {
-                print_error();
-            } else {
-                if (kill(pid, SIGTERM) != 0) {
-                    print_error();
-                }
-            }
-        }
+    const BuiltinEntry *entry = find_builtin(args[0]);
+    if (entry) {
+        builtin_invoke(entry, args);
     } else if (args[0][0] == '!' && isdigit(args[0][1])) {
         int num = atoi(args[0] + 1);
         char *cmd = get_history_command(num);
@@ -116,4 +213,4 @@ void execute_builtin(char **args) {
             free(cmd_dup);
         }
     }
-}
\ No newline at end of file
+}
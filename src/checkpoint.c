@@ -0,0 +1,248 @@
+#include "shell.h"
+#include <stdint.h>
+
+/* Checkpoint and resume for long batch runs.
+ *
+ *   gush --checkpoint FILE script.gush            record progress
+ *   gush --checkpoint FILE --resume script.gush   skip what is done
+ *
+ * After each top-level line (or whole for/while/if block) finishes, one
+ * record is appended to FILE:
+ *
+ *   LINE HASH STATUS
+ *
+ * LINE is the input line number, HASH is a 64-bit FNV-1a hash of its text
+ * (of every line of a block, as the block is read) and STATUS is its exit
+ * status. Each record is one write(), so a crash of the shell loses
+ * nothing. fdatasync() runs every CHECKPOINT_SYNC_LINES records or
+ * CHECKPOINT_SYNC_SECS seconds, and at exit, so a power loss loses at most
+ * the last unsynced batch. Those lines simply run again.
+ *
+ * With --resume, lines are skipped for as long as they match the records
+ * in order (same number, same text). The first line that does not match
+ * runs, and so does everything after it. A block is read in full before
+ * it is checked. The text check means an edited script resumes from the
+ * first edit, including one inside a block. A skipped line is still added
+ * to history and sets $? to its recorded status.
+ *
+ * Commands that only change shell state are not skipped, so later lines
+ * see the same environment: a cd, pushd, popd, path or enable, "ulimit"
+ * with options only, and "sched --background". In a skipped list such as
+ * "cd /x; make", just those commands run again. A skipped block that
+ * contains one runs again in full, since whether its cd ran depended on
+ * its loop or test; its earlier record still stands.
+ */
+
+#define CHECKPOINT_SYNC_LINES 64
+#define CHECKPOINT_SYNC_SECS 1.0
+
+typedef struct Record {
+    int line;
+    uint64_t hash;
+    int status;
+} Record;
+
+int g_checkpoint = 0;
+
+static int ckpt_fd = -1;
+static pid_t ckpt_owner = 0;
+static Record *done;        // Records from the run being resumed
+static int done_count;
+static int done_next;       // Next record a skipped line must match
+static int resuming = 0;
+static int pending = 0;     // Records written since the last sync
+static double last_sync = 0;
+static int current_line;
+static uint64_t current_hash;
+static int current_done;    // checkpoint_completed() matched it, so no record
+
+#define FNV_BASIS 14695981039346656037ull
+
+static uint64_t hash_text(uint64_t h, const char *text) {
+    for (const unsigned char *p = (const unsigned char *)text; *p; p++) {
+        h ^= *p;
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
+static void checkpoint_sync(void) {
+    if (pending > 0) {
+        fdatasync(ckpt_fd);
+        pending = 0;
+    }
+    last_sync = now_seconds();
+}
+
+static void checkpoint_close(void) {
+    if (ckpt_fd < 0 || getpid() != ckpt_owner) {
+        return;
+    }
+    checkpoint_sync();
+    close(ckpt_fd);
+    ckpt_fd = -1;
+    g_checkpoint = 0;
+}
+
+/* Read the records of an earlier run. A record numbered at or below its
+ * predecessor starts a later run that diverged there (the file is only
+ * ever appended to), so it replaces the records it overlaps. A torn last
+ * record is ignored.
+ */
+static void load_records(FILE *in) {
+    char buf[128];
+    int cap = 0;
+    while (fgets(buf, sizeof(buf), in)) {
+        Record r;
+        unsigned long long hash;
+        char nl;
+        if (sscanf(buf, "%d %llx %d%c", &r.line, &hash, &r.status, &nl) != 4 || nl != '\n') {
+            continue;
+        }
+        r.hash = hash;
+        while (done_count > 0 && done[done_count - 1].line >= r.line) {
+            done_count--;
+        }
+        if (done_count == cap) {
+            cap = cap ? cap * 2 : 1024;
+            done = mem_realloc(MEM_EXEC, done, sizeof(Record) * cap);
+        }
+        done[done_count++] = r;
+    }
+}
+
+/* Open FILE for --checkpoint; with resume, load what it already records
+ * and keep appending, otherwise start it afresh.
+ */
+int checkpoint_open(const char *path, int resume) {
+    if (resume) {
+        FILE *in = fopen(path, "re");
+        if (in) {
+            load_records(in);
+            fclose(in);
+        } else if (errno != ENOENT) {
+            return -1;
+        }
+        resuming = done_count > 0;
+    }
+    ckpt_fd = open(path, O_WRONLY | O_CREAT | O_CLOEXEC | (resume ? O_APPEND : O_TRUNC), 0666);
+    if (ckpt_fd < 0) {
+        return -1;
+    }
+    ckpt_owner = getpid();
+    last_sync = now_seconds();
+    g_checkpoint = 1;
+    atexit(checkpoint_close);
+    return 0;
+}
+
+// Note the line about to run; its text is hashed before the parser splits it.
+void checkpoint_begin(const char *line) {
+    current_line = g_line_number;
+    current_hash = hash_text(FNV_BASIS, line);
+    current_done = 0;
+}
+
+// Add a further line of the block begun by checkpoint_begin() to its hash.
+void checkpoint_extend(const char *line) {
+    current_hash = hash_text(current_hash, "\n");
+    current_hash = hash_text(current_hash, line);
+}
+
+/* Whether an earlier run completed the line (or block) passed to
+ * checkpoint_begin(); if so its recorded status is stored in *status.
+ */
+int checkpoint_completed(int *status) {
+    if (!resuming) {
+        return 0;
+    }
+    if (done_next < done_count && done[done_next].line == current_line &&
+        done[done_next].hash == current_hash) {
+        *status = done[done_next++].status;
+        current_done = 1;
+        return 1;
+    }
+    resuming = 0;
+    fprintf(stderr, "gush: resuming at line %d (%d lines already done)\n",
+            current_line, done_next);
+    mem_free(MEM_EXEC, done);
+    done = NULL;
+    return 0;
+}
+
+/* Record that the line passed to checkpoint_begin() finished with status,
+ * unless an earlier run already did.
+ */
+void checkpoint_end(int status) {
+    if (current_done) {
+        return;
+    }
+    char rec[64];
+    int len = snprintf(rec, sizeof(rec), "%d %016llx %d\n", current_line,
+                       (unsigned long long)current_hash, status);
+    while (write(ckpt_fd, rec, len) < 0 && errno == EINTR) {
+    }
+    pending++;
+    if (pending >= CHECKPOINT_SYNC_LINES || now_seconds() - last_sync >= CHECKPOINT_SYNC_SECS) {
+        checkpoint_sync();
+    }
+}
+
+static int only_limit_options(char **words, int count) {
+    if (count < 3 || (count - 1) % 2 != 0) {
+        return 0;
+    }
+    for (int i = 1; i < count; i += 2) {
+        if (words[i][0] != '-' || !words[i][1] || words[i][2]) return 0;
+    }
+    return 1;
+}
+
+/* Whether a single command changes shell state rather than doing work:
+ * a cd, pushd, popd, path or enable, or a ulimit/sched line that sets the
+ * defaults.
+ */
+int checkpoint_changes_state(const char *command) {
+    if (strpbrk(command, ";|&<>")) {
+        return 0;
+    }
+    char *copy = mem_strdup(MEM_PARSER, command);
+    char *words[MAX_ARGS];
+    int count = 0;
+    char *save;
+    for (char *w = strtok_r(copy, " \t", &save); w && count < MAX_ARGS;
+         w = strtok_r(NULL, " \t", &save)) {
+        words[count++] = w;
+    }
+    int replay = 0;
+    if (count > 0) {
+        replay = strcmp(words[0], "cd") == 0 || strcmp(words[0], "pushd") == 0 ||
+                 strcmp(words[0], "popd") == 0 || strcmp(words[0], "path") == 0 ||
+                 strcmp(words[0], "enable") == 0 ||
+                 (strcmp(words[0], "ulimit") == 0 && only_limit_options(words, count)) ||
+                 (strcmp(words[0], "sched") == 0 && count > 1 &&
+                  strcmp(words[1], "--background") == 0);
+    }
+    mem_free(MEM_PARSER, copy);
+    return replay;
+}
+
+/* Run again the commands of a skipped line that change shell state: the
+ * whole line, or each such command of a ';' list in order.
+ */
+void checkpoint_replay(const char *line) {
+    char *copy = mem_strdup(MEM_PARSER, line);
+    char *command = copy;
+    while (command) {
+        char *semi = list_separator(command);
+        if (semi) {
+            *semi = '\0';
+        }
+        while (isspace((unsigned char)*command)) command++;
+        if (checkpoint_changes_state(command)) {
+            process_line(command);
+        }
+        command = semi ? semi + 1 : NULL;
+    }
+    mem_free(MEM_PARSER, copy);
+}
@@ -0,0 +1,266 @@
+#include "shell.h"
+#include <dirent.h>
+#include <limits.h>
+#include <sys/stat.h>
+
+/* Command-name completion index.
+ *
+ * Every executable in the g_path directories goes into a prefix trie. Each
+ * node counts the names in its subtree, so a completion walks the prefix
+ * once and already knows how many names match. From there it follows
+ * single-child nodes to the longest common extension, and lists names only
+ * when asked. The cost depends on the prefix and on the number of names
+ * listed, not on how many binaries are on PATH.
+ *
+ * The trie is built on the first completion. Before each later completion,
+ * complete_refresh() stat()s every path directory once. A directory whose
+ * mtime or inode changed is rescanned, and only its own names are swapped
+ * out. Directories added to or dropped from the path by "path" are
+ * scanned or removed the same way. A name provided by several directories
+ * is counted once per directory, so it stays until the last one drops it.
+ */
+
+typedef struct TrieNode {
+    unsigned char ch;
+    int refs;                   // Directories providing the name ending here
+    int names;                  // Names ending in this subtree
+    int nchild;
+    int cap;
+    struct TrieNode **child;    // Sorted by ch
+} TrieNode;
+
+typedef struct PathDir {
+    char *path;
+    dev_t dev;
+    ino_t ino;
+    struct timespec mtime;
+    char **names;               // Names this directory put in the trie
+    int count;
+    int seen;                   // Still on the path (refresh bookkeeping)
+} PathDir;
+
+static TrieNode root;
+static PathDir *dirs;
+static int dir_count;
+static int dir_cap;
+
+static TrieNode *find_child(const TrieNode *node, unsigned char ch, int *slot) {
+    int lo = 0, hi = node->nchild;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (node->child[mid]->ch < ch) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if (slot) *slot = lo;
+    return lo < node->nchild && node->child[lo]->ch == ch ? node->child[lo] : NULL;
+}
+
+static void trie_insert(const char *name) {
+    TrieNode *node = &root;
+    // Count first: a name already present changes no subtree totals
+    TrieNode *end = &root;
+    for (const unsigned char *p = (const unsigned char *)name; *p && end; p++) {
+        end = find_child(end, *p, NULL);
+    }
+    int is_new = !end || end->refs == 0;
+    if (is_new) root.names++;
+    for (const unsigned char *p = (const unsigned char *)name; *p; p++) {
+        int slot;
+        TrieNode *next = find_child(node, *p, &slot);
+        if (!next) {
+            if (node->nchild == node->cap) {
+                int new_cap = node->cap ? node->cap * 2 : 2;
+                node->child = mem_realloc(MEM_PATH, node->child, sizeof(TrieNode *) * new_cap);
+                node->cap = new_cap;
+            }
+            next = mem_calloc(MEM_PATH, 1, sizeof(TrieNode));
+            next->ch = *p;
+            memmove(&node->child[slot + 1], &node->child[slot],
+                    sizeof(TrieNode *) * (node->nchild - slot));
+            node->child[slot] = next;
+            node->nchild++;
+        }
+        node = next;
+        if (is_new) node->names++;
+    }
+    node->refs++;
+}
+
+static void trie_free(TrieNode *node) {
+    for (int i = 0; i < node->nchild; i++) {
+        trie_free(node->child[i]);
+        mem_free(MEM_PATH, node->child[i]);
+    }
+    mem_free(MEM_PATH, node->child);
+}
+
+static void trie_remove(const char *name) {
+    TrieNode *path[NAME_MAX + 2];
+    TrieNode *node = &root;
+    int len = 0;
+    path[len++] = node;
+    for (const unsigned char *p = (const unsigned char *)name; *p; p++) {
+        node = find_child(node, *p, NULL);
+        if (!node || len > NAME_MAX) return;
+        path[len++] = node;
+    }
+    if (node->refs == 0 || --node->refs > 0) {
+        return;
+    }
+    for (int i = 0; i < len; i++) {
+        path[i]->names--;
+    }
+    // Unlink the nodes left without names, deepest first
+    for (int i = len - 1; i > 0 && path[i]->names == 0; i--) {
+        TrieNode *parent = path[i - 1];
+        int slot;
+        find_child(parent, path[i]->ch, &slot);
+        trie_free(path[i]);
+        mem_free(MEM_PATH, path[i]);
+        memmove(&parent->child[slot], &parent->child[slot + 1],
+                sizeof(TrieNode *) * (parent->nchild - slot - 1));
+        parent->nchild--;
+    }
+}
+
+static void drop_names(PathDir *d) {
+    for (int i = 0; i < d->count; i++) {
+        trie_remove(d->names[i]);
+        mem_free(MEM_PATH, d->names[i]);
+    }
+    mem_free(MEM_PATH, d->names);
+    d->names = NULL;
+    d->count = 0;
+}
+
+static void scan_dir(PathDir *d, const struct stat *st) {
+    d->dev = st->st_dev;
+    d->ino = st->st_ino;
+    d->mtime = st->st_mtim;
+    DIR *dir = opendir(d->path);
+    if (!dir) {
+        return;
+    }
+    int cap = 0;
+    struct dirent *ent;
+    while ((ent = readdir(dir)) != NULL) {
+        if (ent->d_name[0] == '.' || ent->d_type == DT_DIR ||
+            strlen(ent->d_name) > NAME_MAX) {
+            continue;
+        }
+        struct stat est;
+        if (fstatat(dirfd(dir), ent->d_name, &est, 0) != 0 || !S_ISREG(est.st_mode) ||
+            faccessat(dirfd(dir), ent->d_name, X_OK, 0) != 0) {
+            continue;
+        }
+        if (d->count == cap) {
+            cap = cap ? cap * 2 : 64;
+            d->names = mem_realloc(MEM_PATH, d->names, sizeof(char *) * cap);
+        }
+        d->names[d->count] = mem_strdup(MEM_PATH, ent->d_name);
+        trie_insert(d->names[d->count++]);
+    }
+    closedir(dir);
+    DEBUG_PRINTF("Completion: %d executables in %s\n", d->count, d->path);
+}
+
+// Bring the trie in line with g_path and the directories' current contents.
+void complete_refresh(void) {
+    for (int i = 0; i < dir_count; i++) {
+        dirs[i].seen = 0;
+    }
+    for (int p = 0; p < g_path_count; p++) {
+        PathDir *d = NULL;
+        for (int i = 0; i < dir_count; i++) {
+            if (strcmp(dirs[i].path, g_path[p]) == 0) d = &dirs[i];
+        }
+        struct stat st;
+        int ok = stat(g_path[p], &st) == 0;
+        if (!d) {
+            if (dir_count == dir_cap) {
+                int new_cap = dir_cap ? dir_cap * 2 : 8;
+                dirs = mem_realloc(MEM_PATH, dirs, sizeof(PathDir) * new_cap);
+                dir_cap = new_cap;
+            }
+            d = &dirs[dir_count++];
+            memset(d, 0, sizeof(*d));
+            d->path = mem_strdup(MEM_PATH, g_path[p]);
+            if (ok) scan_dir(d, &st);
+        } else if (!ok) {
+            drop_names(d);
+            d->ino = 0;  // Rescan whatever appears there later
+        } else if (st.st_dev != d->dev || st.st_ino != d->ino ||
+                   st.st_mtim.tv_sec != d->mtime.tv_sec ||
+                   st.st_mtim.tv_nsec != d->mtime.tv_nsec) {
+            drop_names(d);
+            scan_dir(d, &st);
+        }
+        d->seen = 1;
+    }
+    for (int i = dir_count - 1; i >= 0; i--) {
+        if (!dirs[i].seen) {
+            drop_names(&dirs[i]);
+            mem_free(MEM_PATH, dirs[i].path);
+            dirs[i] = dirs[--dir_count];
+        }
+    }
+}
+
+static int collect(const TrieNode *node, char *buf, int len, char **out, int n, int max) {
+    if (n >= max) {
+        return n;
+    }
+    if (node->refs > 0) {
+        buf[len] = '\0';
+        out[n] = strdup(buf);
+        if (!out[n]) {
+            print_error();
+            exit(1);
+        }
+        n++;
+    }
+    for (int i = 0; i < node->nchild && n < max; i++) {
+        buf[len] = (char)node->child[i]->ch;
+        n = collect(node->child[i], buf, len + 1, out, n, max);
+    }
+    return n;
+}
+
+/* Complete a command name. Returns how many executables start with
+ * prefix; the longest prefix they all share (prefix itself at least) goes
+ * to common, and the first max of them in sorted order to names (each
+ * malloc'd, for the caller to free).
+ */
+int complete_command(const char *prefix, char *common, size_t size, char **names, int max) {
+    const TrieNode *node = &root;
+    size_t len = strlen(prefix);
+    char buf[NAME_MAX + 2];
+    if (len > NAME_MAX) {
+        return 0;
+    }
+    for (const unsigned char *p = (const unsigned char *)prefix; *p && node; p++) {
+        node = find_child(node, *p, NULL);
+    }
+    if (!node || node->names == 0) {
+        return 0;
+    }
+    memcpy(buf, prefix, len);
+    size_t common_len = len;
+    const TrieNode *walk = node;
+    while (walk->refs == 0 && walk->nchild == 1 && common_len < NAME_MAX) {
+        walk = walk->child[0];
+        buf[common_len++] = (char)walk->ch;
+    }
+    if (size > 0) {
+        size_t n = common_len < size - 1 ? common_len : size - 1;
+        memcpy(common, buf, n);
+        common[n] = '\0';
+    }
+    if (names && max > 0) {
+        collect(node, buf, (int)len, names, 0, max);
+    }
+    return node->names;
+}
@@ -0,0 +1,190 @@
+#include "shell.h"
+
+/* Cached working directory and the directory stack.
+ *
+ *   cd DIR          change directory
+ *   pushd DIR       save the current directory on the stack and cd to DIR
+ *   pushd           swap the current directory with the top of the stack
+ *   popd            return to the directory on top of the stack
+ *   dirs            print the current directory, then the stack
+ *
+ * The shell keeps its working directory as a path string and an O_PATH
+ * descriptor. Both change only here (cd, the directory stack, and the
+ * command server adopting a client's directory). pwd, memo keys and the
+ * server client read the string instead of calling getcwd(). Redirections
+ * open relative paths with openat() on the descriptor. Every stack entry
+ * holds its own descriptor, so pushd and popd return to a directory with
+ * fchdir() and never look its path up again. A directory that is moved
+ * keeps working, but its remembered path goes stale.
+ */
+
+typedef struct DirEntry {
+    int fd;             // O_PATH descriptor
+    char *path;
+} DirEntry;
+
+static DirEntry current = {-1, NULL};
+static DirEntry *stack;     // stack[depth - 1] is the top
+static int depth;
+static int stack_cap;
+
+static int open_dir(const char *path) {
+    return open(path, O_PATH | O_DIRECTORY | O_CLOEXEC);
+}
+
+// Path of the directory just entered; the only getcwd() the shell makes.
+static char *current_path(void) {
+    char buf[4096];
+    // Unreachable or too long: "." is still usable via the fd
+    return mem_strdup(MEM_PATH, getcwd(buf, sizeof(buf)) ? buf : ".");
+}
+
+static void ensure_current(void) {
+    if (current.fd < 0) {
+        current.fd = open_dir(".");
+        mem_free(MEM_PATH, current.path);
+        current.path = current_path();
+    }
+}
+
+const char *cwd_path(void) {
+    ensure_current();
+    return current.path;
+}
+
+// O_PATH descriptor for the working directory (AT_FDCWD if unavailable).
+int cwd_dirfd(void) {
+    ensure_current();
+    return current.fd >= 0 ? current.fd : AT_FDCWD;
+}
+
+// open() relative to the cached working directory.
+int cwd_openat(const char *path, int flags, mode_t mode) {
+    return openat(cwd_dirfd(), path, flags, mode);
+}
+
+/* Child side, before redirections: keep the directory descriptor clear of
+ * the descriptors about to be redirected, so an "N> file" onto the same
+ * number cannot replace it while later targets still need it.
+ */
+void cwd_reserve_child(const Redirect *redirs, int count) {
+    int clash = 0, top = 0;
+    for (int i = 0; i < count; i++) {
+        if (redirs[i].fd == current.fd) clash = 1;
+        if (redirs[i].fd > top) top = redirs[i].fd;
+    }
+    if (clash) {
+        // On failure cwd_dirfd() reopens ".", which is the same directory
+        current.fd = fcntl(current.fd, F_DUPFD_CLOEXEC, top + 1);
+    }
+}
+
+// Make fd current; path (NULL to look it up) is taken over.
+static int enter(int fd, char *path) {
+    if (fchdir(fd) != 0) {
+        return -1;
+    }
+    if (current.fd >= 0) close(current.fd);
+    mem_free(MEM_PATH, current.path);
+    current.fd = fd;
+    current.path = path ? path : current_path();
+    return 0;
+}
+
+// chdir() that keeps the cache in step; -1 (errno set) on failure.
+int cwd_change(const char *path) {
+    ensure_current();
+    int fd = open_dir(path);
+    if (fd < 0) {
+        return -1;
+    }
+    if (enter(fd, NULL) != 0) {
+        close(fd);
+        return -1;
+    }
+    return 0;
+}
+
+void builtin_cd(char **args) {
+    if (args[1] == NULL || args[2] != NULL) {
+        print_error();
+    } else {
+        if (cwd_change(args[1]) != 0) {
+            print_error();
+        }
+    }
+}
+
+void builtin_pwd(char **args) {
+    (void)args;
+    printf("%s\n", cwd_path());
+}
+
+static void push(DirEntry entry) {
+    if (depth == stack_cap) {
+        int new_cap = stack_cap ? stack_cap * 2 : 8;
+        stack = mem_realloc(MEM_PATH, stack, sizeof(DirEntry) * new_cap);
+        stack_cap = new_cap;
+    }
+    stack[depth++] = entry;
+}
+
+static void print_dirs(void) {
+    printf("%s", cwd_path());
+    for (int i = depth - 1; i >= 0; i--) {
+        printf(" %s", stack[i].path);
+    }
+    printf("\n");
+}
+
+void builtin_pushd(char **args) {
+    ensure_current();
+    if (current.fd < 0 || (args[1] && args[2])) {
+        print_error();
+        return;
+    }
+    DirEntry saved = current;
+    if (!args[1]) {
+        // Swap with the top entry: a plain fchdir() to its descriptor
+        if (depth == 0 || fchdir(stack[depth - 1].fd) != 0) {
+            print_error();
+            return;
+        }
+        current = stack[depth - 1];
+        stack[depth - 1] = saved;
+        print_dirs();
+        return;
+    }
+    int fd = open_dir(args[1]);
+    if (fd < 0 || fchdir(fd) != 0) {
+        if (fd >= 0) close(fd);
+        print_error();
+        return;
+    }
+    push(saved);
+    current.fd = fd;
+    current.path = current_path();
+    print_dirs();
+}
+
+void builtin_popd(char **args) {
+    if (args[1] || depth == 0) {
+        print_error();
+        return;
+    }
+    DirEntry top = stack[depth - 1];
+    if (enter(top.fd, top.path) != 0) {
+        print_error();
+        return;
+    }
+    depth--;
+    print_dirs();
+}
+
+void builtin_dirs(char **args) {
+    if (args[1]) {
+        print_error();
+        return;
+    }
+    print_dirs();
+}
@@ -1,4 +1,95 @@
 #include "shell.h"
+#include <sys/syscall.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+// ------------------------
+// Executable lookup cache
+// ------------------------
+
+/* Maps a command name to the PATH entry it resolved to. Entries carry the
+ * path generation they were found under, so the "path" builtin invalidates
+ * everything by bumping the generation. Hits are re-checked with one
+ * access() call, so a deleted binary falls back to a full search.
+ */
+#define LOOKUP_CACHE_SIZE 4096  // Power of two
+#define LOOKUP_PROBES 8
+
+typedef struct LookupEntry {
+    char *name;
+    char *path;
+    unsigned generation;
+} LookupEntry;
+
+static LookupEntry lookup_cache[LOOKUP_CACHE_SIZE];
+static unsigned path_generation = 1;
+
+static unsigned long hash_name(const char *s) {
+    unsigned long h = 5381;
+    while (*s) {
+        h = h * 33 + (unsigned char)*s++;
+    }
+    return h;
+}
+
+void lookup_cache_invalidate(void) {
+    path_generation++;
+}
+
+static const char *lookup_cache_get(const char *name) {
+    unsigned long h = hash_name(name);
+    for (int i = 0; i < LOOKUP_PROBES; i++) {
+        LookupEntry *e = &lookup_cache[(h + i) & (LOOKUP_CACHE_SIZE - 1)];
+        if (!e->name) {
+            return NULL;
+        }
+        if (e->generation == path_generation && strcmp(e->name, name) == 0) {
+            return e->path;
+        }
+    }
+    return NULL;
+}
+
+static void lookup_cache_put(const char *name, const char *path) {
+    unsigned long h = hash_name(name);
+    LookupEntry *slot = &lookup_cache[h & (LOOKUP_CACHE_SIZE - 1)];
+    for (int i = 0; i < LOOKUP_PROBES; i++) {
+        LookupEntry *e = &lookup_cache[(h + i) & (LOOKUP_CACHE_SIZE - 1)];
+        if (!e->name || e->generation != path_generation || strcmp(e->name, name) == 0) {
+            slot = e;
+            break;
+        }
+    }
+    // With every probe slot live, the home slot is overwritten.
+    mem_free(MEM_PATH, slot->name);
+    mem_free(MEM_PATH, slot->path);
+    slot->name = mem_strdup(MEM_PATH, name);
+    slot->path = mem_strdup(MEM_PATH, path);
+    slot->generation = path_generation;
+}
+
+/* Fill the cache with every executable on the search path, so a long-lived
+ * shell (e.g. --serve) starts warm. Directories are scanned last to first
+ * so that earlier PATH entries win.
+ */
+void lookup_cache_prewarm(void) {
+    char full_path[4096];
+    for (int i = g_path_count - 1; i >= 0; i--) {
+        DIR *dir = opendir(g_path[i]);
+        if (!dir) continue;
+        struct dirent *ent;
+        while ((ent = readdir(dir)) != NULL) {
+            if (ent->d_name[0] == '.') continue;
+            snprintf(full_path, sizeof(full_path), "%s/%s", g_path[i], ent->d_name);
+            struct stat st;
+            if (stat(full_path, &st) == 0 && S_ISREG(st.st_mode) &&
+                access(full_path, X_OK) == 0) {
+                lookup_cache_put(ent->d_name, full_path);
+            }
+        }
+        closedir(dir);
+    }
+}
 
 char *search_executable(char *command) {
     if (!command) {
@@ -22,7 +113,7 @@ char *search_executable(char *command) {
             DEBUG_PRINTF("Trying grep at: %s\n", grep_paths[i]);
             if (access(grep_paths[i], X_OK) == 0) {
                 DEBUG_PRINTF("Found grep at: %s\n", grep_paths[i]);
-                return strdup(grep_paths[i]);
+                return mem_strdup(MEM_EXEC, grep_paths[i]);
             }
         }
     }
@@ -32,7 +123,7 @@ char *search_executable(char *command) {
         DEBUG_PRINT("Checking /usr/bin for nl command\n");
         if (access("/usr/bin/nl", X_OK) == 0) {
             DEBUG_PRINT("Found nl in /usr/bin\n");
-            return strdup("/usr/bin/nl");
+            return mem_strdup(MEM_EXEC, "/usr/bin/nl");
         }
     }
 
@@ -42,30 +133,27 @@ char *search_executable(char *command) {
         (command[0] == '.' && command[1] == '.' && command[2] == '/')) {
         DEBUG_PRINT("Treating as direct path\n");
         if (access(command, X_OK) == 0) {
-            char *result = strdup(command);
-            if (result) {
-                DEBUG_PRINT("Found local executable\n");
-            }
-            return result;
+            DEBUG_PRINT("Found local executable\n");
+            return mem_strdup(MEM_EXEC, command);
         }
         DEBUG_PRINT("Local executable not found or not executable\n");
         return NULL;
     }
 
     // Search in current directory first
-    char current_path[1024];
-    if (getcwd(current_path, sizeof(current_path)) != NULL) {
-        int len = strlen(current_path) + strlen(command) + 3;
-        char *full_path = malloc(len);
-        if (full_path) {
-            snprintf(full_path, len, "./%s", command);
-            DEBUG_PRINTF("Trying current dir: %s\n", full_path);
-            if (access(full_path, X_OK) == 0) {
-                DEBUG_PRINT("Found in current directory\n");
-                return full_path;
-            }
-            free(full_path);
-        }
+    if (faccessat(cwd_dirfd(), command, X_OK, 0) == 0) {
+        int len = strlen(command) + 3;
+        char *full_path = mem_malloc(MEM_EXEC, len);
+        snprintf(full_path, len, "./%s", command);
+        DEBUG_PRINTF("Found in current directory: %s\n", full_path);
+        return full_path;
+    }
+
+    // Then the lookup cache, re-validated with a single access()
+    const char *cached = lookup_cache_get(command);
+    if (cached && access(cached, X_OK) == 0) {
+        DEBUG_PRINTF("Lookup cache hit: %s\n", cached);
+        return mem_strdup(MEM_EXEC, cached);
     }
 
     // Then search in PATH directories
@@ -73,33 +161,275 @@ char *search_executable(char *command) {
         DEBUG_PRINTF("Checking path: %s\n", g_path[i]);
         
         int len = strlen(g_path[i]) + strlen(command) + 2;
-        char *full_path = malloc(len);
-        if (!full_path) {
-            DEBUG_PRINT("Memory allocation failed\n");
-            print_error();
-            exit(1);
-        }
+        char *full_path = mem_malloc(MEM_EXEC, len);
         snprintf(full_path, len, "%s/%s", g_path[i], command);
         DEBUG_PRINTF("Trying path: %s\n", full_path);
 
         if (access(full_path, X_OK) == 0) {
             DEBUG_PRINT("Found executable in path\n");
+            lookup_cache_put(command, full_path);
             return full_path;
         }
-        free(full_path);
+        mem_free(MEM_EXEC, full_path);
     }
     
     DEBUG_PRINT("Executable not found in any path\n");
     return NULL;
 }
 
-void execute_external(char **args, int background, char *input_file, char *output_file) {
+// Convert a waitpid() status into a shell-style exit code (128+N for signals)
+int exit_status_code(int status) {
+    if (WIFEXITED(status)) {
+        return WEXITSTATUS(status);
+    }
+    if (WIFSIGNALED(status)) {
+        return 128 + WTERMSIG(status);
+    }
+    return 1;
+}
+
+// Close fds lo..hi (inclusive), with a loop where close_range() is missing.
+static void close_fd_range(unsigned lo, unsigned hi) {
+#ifdef SYS_close_range
+    if (syscall(SYS_close_range, lo, hi, 0) == 0) {
+        return;
+    }
+#endif
+    struct rlimit rl;
+    long max_fd = getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur != RLIM_INFINITY
+                  ? (long)rl.rlim_cur : 1024;
+    for (long fd = lo; fd <= (long)hi && fd < max_fd && fd < 65536; fd++) {
+        close((int)fd);
+    }
+}
+
+/* Called in a forked child once its stdio is in place: close every other
+ * descriptor so nothing the shell holds (batch file, pipe ends of other
+ * stages, log or trace files) leaks across execve(). Shell-owned fds are
+ * also opened O_CLOEXEC; this catches anything inherited from our parent.
+ */
+void close_inherited_fds(void) {
+    close_fd_range(3, ~0U);
+}
+
+/* close_inherited_fds(), except for the descriptors in keep (any order;
+ * values below 3 are ignored).
+ */
+void close_fds_except(const int *keep, int count) {
+    unsigned next = 3;
+    for (;;) {
+        // Smallest kept fd not yet passed
+        unsigned target = ~0U;
+        for (int i = 0; i < count; i++) {
+            if ((unsigned)keep[i] >= next && (unsigned)keep[i] < target) {
+                target = (unsigned)keep[i];
+            }
+        }
+        if (target == ~0U) {
+            close_fd_range(next, ~0U);
+            return;
+        }
+        if (target > next) {
+            close_fd_range(next, target - 1);
+        }
+        next = target + 1;
+    }
+}
+
+/* close_inherited_fds(), except for the targets above 2 that the command's
+ * own redirections (e.g. "3> file") just set up.
+ */
+static void close_fds_except_redirections(const Redirect *redirs, int count) {
+    int keep[count > 0 ? count : 1];
+    for (int i = 0; i < count; i++) {
+        keep[i] = redirs[i].fd;
+    }
+    close_fds_except(keep, count);
+}
+
+/* Open the file behind an input redirection, or duplicate a coprocess's
+ * output for "< %NAME". Returns a close-on-exec fd, or -1.
+ */
+static int open_input(const char *path) {
+    if (path[0] == '%') {
+        int fd = coproc_fd(path + 1, 0);
+        return fd < 0 ? -1 : fcntl(fd, F_DUPFD_CLOEXEC, 0);
+    }
+    return cwd_openat(path, O_RDONLY | O_CLOEXEC, 0);
+}
+
+/* Apply a command's output redirections in order (child side, while the
+ * coprocess pipes are still open; close_fds_except_redirections() runs
+ * next). Files are opened O_APPEND for >> and O_TRUNC otherwise;
+ * "> %NAME" writes to a coprocess's stdin. "prealloc" reserves the space
+ * with fallocate() so a large sequential write does not extend the file
+ * block by block. Exits on failure.
+ */
+static void apply_redirections(const Redirect *redirs, int count) {
+    for (int i = 0; i < count; i++) {
+        const Redirect *r = &redirs[i];
+        if (r->dup_from >= 0) {
+            if (r->dup_from != r->fd && dup2(r->dup_from, r->fd) < 0) {
+                DEBUG_PRINTF("Failed to duplicate fd %d onto %d\n", r->dup_from, r->fd);
+                print_error();
+                _exit(1);
+            }
+            continue;
+        }
+        int fd;
+        if (r->path[0] == '%') {
+            fd = coproc_fd(r->path + 1, 1);
+            fd = fd < 0 ? -1 : fcntl(fd, F_DUPFD_CLOEXEC, 0);
+        } else {
+            int flags = O_WRONLY | O_CREAT | O_CLOEXEC | (r->append ? O_APPEND : O_TRUNC);
+            fd = cwd_openat(r->path, flags, 0666);
+        }
+        if (fd < 0) {
+            DEBUG_PRINTF("Failed to open %s for fd %d\n", r->path, r->fd);
+            print_error();
+            _exit(1);
+        }
+        if (r->prealloc > 0) {
+            off_t start = r->append ? lseek(fd, 0, SEEK_END) : 0;
+            // Only a hint: filesystems without fallocate just grow the file.
+            if (fallocate(fd, FALLOC_FL_KEEP_SIZE, start, r->prealloc) != 0) {
+                DEBUG_PRINTF("fallocate on %s failed, errno: %d\n", r->path, errno);
+            }
+        }
+        if (fd != r->fd) {
+            if (dup2(fd, r->fd) < 0) {
+                DEBUG_PRINT("Failed to redirect output\n");
+                print_error();
+                _exit(1);
+            }
+            close(fd);
+        } else {
+            fcntl(fd, F_SETFD, 0);  // Opened straight onto its target
+        }
+    }
+}
+
+/* After a foreground job: give back preallocated space the command did
+ * not use, and write back every "nocache" target and drop it from the
+ * page cache, so a big output file does not evict everything else.
+ */
+static void finish_redirections(const Redirect *redirs, int count) {
+    for (int i = 0; i < count; i++) {
+        const Redirect *r = &redirs[i];
+        if (!r->path || r->path[0] == '%' || (!r->nocache && r->prealloc <= 0)) {
+            continue;
+        }
+        int fd = cwd_openat(r->path, O_WRONLY | O_CLOEXEC, 0);
+        if (fd < 0) {
+            continue;
+        }
+        struct stat st;
+        if (r->prealloc > 0 && fstat(fd, &st) == 0) {
+            // Truncating to the current size frees blocks kept past EOF.
+            if (ftruncate(fd, st.st_size) != 0) {
+                DEBUG_PRINTF("Trimming %s failed, errno: %d\n", r->path, errno);
+            }
+        }
+        if (r->nocache) {
+            fdatasync(fd);
+            posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        }
+        close(fd);
+    }
+}
+
+/* Last steps of every spawned child, once its descriptors are in place:
+ * apply the sched and ulimit settings, then run an in-shell filter or
+ * exec the resolved path with PATH as its only environment variable.
+ * Never returns; a failed exec leaves with _exit(1) so the shell's stdio
+ * buffers are not flushed a second time.
+ */
+static void exec_child(char **args, const char *exec_path, int filter, int background,
+                       int stage) {
+    sched_apply_child(background);
+    limits_apply_child();
+    TRACE(TRACE_EXEC, 'i', stage);
+    if (filter) {
+        _exit(filter_run(args));
+    }
+    char path_env[1024];
+    snprintf(path_env, sizeof(path_env), "PATH=%s", g_path_count > 0 ? g_path[0] : "");
+    char *envp[] = {path_env, NULL};
+    DEBUG_PRINTF("Executing command: %s\n", exec_path);
+    execve(exec_path, args, envp);
+    DEBUG_PRINTF("execve failed, errno: %d\n", errno);
+    print_error();
+    _exit(1);
+}
+
+/* Fork and exec an external command with its standard streams wired to
+ * the given descriptors (-1 leaves the stream inherited from the shell).
+ * The executable is resolved in the parent, so a missing command reports
+ * the error once and returns -1 without forking.
+ */
+pid_t spawn_external(char **args, int in_fd, int out_fd, int err_fd, int background) {
+    if (!args || !args[0]) {
+        print_error();
+        return -1;
+    }
+
+    // Filters run in the forked child without exec, but only in place of
+    // the tool the lookup finds.
+    TRACE(TRACE_LOOKUP, 'B', 0);
+    char *exec_path = search_executable(args[0]);
+    TRACE(TRACE_LOOKUP, 'E', exec_path != NULL);
+    int filter = filter_supported(args, exec_path);
+    if (!exec_path) {
+        DEBUG_PRINT("Executable not found\n");
+        print_error();
+        return -1;
+    }
+
+    fflush(stdout);  // Unflushed output would be duplicated by the child
+    TRACE(TRACE_FORK, 'B', 0);
+    pid_t pid = fork();
+    if (pid < 0) {
+        TRACE(TRACE_FORK, 'E', -1);
+        DEBUG_PRINT("Fork failed\n");
+        print_error();
+        mem_free(MEM_EXEC, exec_path);
+        return -1;
+    }
+
+    if (pid == 0) {  // Child process
+        int fds[3] = {in_fd, out_fd, err_fd};
+        for (int target = 0; target < 3; target++) {
+            if (fds[target] >= 0 && fds[target] != target) {
+                if (dup2(fds[target], target) < 0) {
+                    print_error();
+                    _exit(1);
+                }
+            }
+        }
+        if (background) {
+            setpgid(0, 0);
+        }
+        close_inherited_fds();
+        exec_child(args, exec_path, filter, background, 0);
+    }
+
+    TRACE(TRACE_FORK, 'E', pid);
+    mem_free(MEM_EXEC, exec_path);
+    if (background) {
+        setpgid(pid, pid);
+    }
+    DEBUG_PRINTF("Spawned %s as PID %d\n", args[0], pid);
+    return pid;
+}
+
+int execute_external(char **args, int background, char *input_file, char *output_file,
+                     const Redirect *redirs, int redir_count) {
     DEBUG_PRINT("\nStarting execute_external\n");
     
     if (!args || !args[0]) {
         DEBUG_PRINT("Invalid args\n");
         print_error();
-        return;
+        return 1;
     }
 
     // Print all arguments for debugging
@@ -117,26 +447,30 @@ void execute_external(char **args, int background, char *input_file, char *outpu
 
     DEBUG_PRINTF("Background mode: %s\n", background ? "yes" : "no");
 
+    // Filters run in the forked child without exec, but only in place of
+    // the tool the lookup finds.
+    TRACE(TRACE_LOOKUP, 'B', 0);
     char *exec_path = search_executable(args[0]);
+    TRACE(TRACE_LOOKUP, 'E', exec_path != NULL);
+    int filter = filter_supported(args, exec_path);
     if (!exec_path) {
         DEBUG_PRINT("Executable not found\n");
         print_error();
-        return;
+        return 1;
     }
 
     DEBUG_PRINTF("Found executable at: %s\n", exec_path);
 
-    // Setup basic environment
-    char path_env[1024];
-    snprintf(path_env, sizeof(path_env), "PATH=%s", g_path[0]);
-    char *envp[] = {path_env, NULL};
-
+    double fork_start = g_log_json ? now_seconds() : 0;
+    fflush(stdout);  // Unflushed output would be duplicated by the child
+    TRACE(TRACE_FORK, 'B', 0);
     pid_t pid = fork();
     if (pid < 0) {
+        TRACE(TRACE_FORK, 'E', -1);
         DEBUG_PRINT("Fork failed\n");
         print_error();
-        free(exec_path);
-        return;
+        mem_free(MEM_EXEC, exec_path);
+        return 1;
     }
 
     if (pid == 0) {  // Child process
@@ -144,11 +478,11 @@ void execute_external(char **args, int background, char *input_file, char *outpu
 
         // Setup standard IO redirections
         if (input_file) {
-            int fd_in = open(input_file, O_RDONLY);
+            int fd_in = open_input(input_file);
             if (fd_in < 0) {
                 DEBUG_PRINT("Failed to open input file\n");
                 print_error();
-                exit(1);
+                _exit(1);
             }
             DEBUG_PRINT("Input file opened successfully\n");
 
@@ -156,25 +490,25 @@ void execute_external(char **args, int background, char *input_file, char *outpu
                 DEBUG_PRINT("Failed to redirect input\n");
                 print_error();
                 close(fd_in);
-                exit(1);
+                _exit(1);
             }
             DEBUG_PRINT("Input redirection successful\n");
             
             close(fd_in);
         }
 
-        if (output_file) {
-            int fd_out = open(output_file, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+        if (output_file && redir_count == 0) {
+            int fd_out = cwd_openat(output_file, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
             if (fd_out < 0) {
                 DEBUG_PRINT("Failed to open output file\n");
                 print_error();
-                exit(1);
+                _exit(1);
             }
             if (dup2(fd_out, STDOUT_FILENO) < 0) {
                 DEBUG_PRINT("Failed to redirect output\n");
                 print_error();
                 close(fd_out);
-                exit(1);
+                _exit(1);
             }
             close(fd_out);
         }
@@ -183,34 +517,36 @@ void execute_external(char **args, int background, char *input_file, char *outpu
         if (background) {
             setpgid(0, 0);
         }
-
-        DEBUG_PRINT("Executing command with execve\n");
-        execve(exec_path, args, envp);
-        
-        // If we get here, execve failed
-        DEBUG_PRINTF("execve failed, errno: %d\n", errno);
-        print_error();
-        free(exec_path);
-        exit(1);
+        cwd_reserve_child(redirs, redir_count);
+        apply_redirections(redirs, redir_count);
+        close_fds_except_redirections(redirs, redir_count);
+        exec_child(args, exec_path, filter, background, 0);
     }
 
     // Parent process
+    TRACE(TRACE_FORK, 'E', pid);
     DEBUG_PRINT("Parent process continuing\n");
-    free(exec_path);
+    if (g_log_json) {
+        log_stage_spawned(0, args, exec_path, pid, now_seconds() - fork_start);
+    }
+    mem_free(MEM_EXEC, exec_path);
 
     // Set up process group for background processes
     if (background) {
         setpgid(pid, pid);
-        printf("[1] %d\n", pid);
+        printf("[%d] %d\n", jobs_add(&pid, 1, args), pid);
         DEBUG_PRINTF("Background process started with PID: %d\n", pid);
-    } else {
-        // Wait for foreground processes
-        int status;
-        waitpid(pid, &status, 0);
-        DEBUG_PRINT("Foreground process completed\n");
+        return 0;
     }
+
+    // Wait for foreground processes under any active deadline
+    int code = wait_children(&pid, 1);
+    finish_redirections(redirs, redir_count);
+    DEBUG_PRINT("Foreground process completed\n");
+    return code;
 }
-void execute_pipeline(Command **commands, int num_cmds, int background) {
+
+int execute_pipeline(Command **commands, int num_cmds, int background) {
     DEBUG_PRINTF("Starting pipeline execution with %d commands\n", num_cmds);
     
     // Debug print pipeline setup
@@ -224,34 +560,57 @@ void execute_pipeline(Command **commands, int num_cmds, int background) {
         }
     }
     
-    int pipes[2][2];  // Two sets of pipes for read/write
-    pid_t *pids = malloc(sizeof(pid_t) * num_cmds);
-    
-    if (!pids) {
-        DEBUG_PRINT("Failed to allocate memory for PIDs\n");
-        print_error();
-        return;
-    }
+    int pipes[2][2] = {{-1, -1}, {-1, -1}};  // Two sets of pipes for read/write
+    pid_t *pids = mem_malloc(MEM_EXEC, sizeof(pid_t) * num_cmds);
+
+    fflush(stdout);  // Unflushed output would be duplicated by the children
+
+    // Relays go in before the stages start (see meter.c)
+    int metered = g_meter && !background && meter_begin(num_cmds - 1) == 0;
 
     // For each command in the pipeline
+    int started = 0;
     for (int i = 0; i < num_cmds; i++) {
         if (i < num_cmds - 1) {
             // Create pipe for all but the last command
-            if (pipe(pipes[i % 2]) < 0) {
+            TRACE(TRACE_PIPE, 'B', i);
+            int piped = pipe2(pipes[i % 2], O_CLOEXEC);
+            TRACE(TRACE_PIPE, 'E', piped == 0 ? pipes[i % 2][0] : -1);
+            if (piped < 0) {
                 DEBUG_PRINT("Pipe creation failed\n");
                 print_error();
-                free(pids);
-                return;
+                break;
+            }
+            if (metered && meter_link(i, pipes[i % 2]) < 0) {
+                DEBUG_PRINT("Relay setup failed\n");
+                print_error();
+                close(pipes[i % 2][0]);
+                close(pipes[i % 2][1]);
+                break;
             }
         }
 
+        // Resolve in the parent so the log knows the path; a missing
+        // command still fails inside its own stage as before.
+        TRACE(TRACE_LOOKUP, 'B', i);
+        char *exec_path = search_executable(commands[i]->tokens[0]);
+        TRACE(TRACE_LOOKUP, 'E', exec_path != NULL);
+        int filter = filter_supported(commands[i]->tokens, exec_path);
+        double fork_start = g_log_json ? now_seconds() : 0;
+        TRACE(TRACE_FORK, 'B', i);
         pids[i] = fork();
         if (pids[i] < 0) {
+            TRACE(TRACE_FORK, 'E', -1);
             DEBUG_PRINT("Fork failed\n");
             print_error();
-            free(pids);
-            return;
+            mem_free(MEM_EXEC, exec_path);
+            if (i < num_cmds - 1) {
+                close(pipes[i % 2][0]);
+                close(pipes[i % 2][1]);
+            }
+            break;
         }
+        started++;
 
         if (pids[i] == 0) {  // Child process
             // Set up input from previous pipe or input redirection
@@ -260,22 +619,22 @@ void execute_pipeline(Command **commands, int num_cmds, int background) {
                 if (dup2(pipes[(i - 1) % 2][0], STDIN_FILENO) < 0) {
                     DEBUG_PRINT("Failed to setup pipe input\n");
                     print_error();
-                    exit(1);
+                    _exit(1);
                 }
             } else if (commands[i]->input_file) {
                 // First command input redirection
                 DEBUG_PRINTF("Setting up input redirection from %s\n", commands[i]->input_file);
-                int fd = open(commands[i]->input_file, O_RDONLY);
+                int fd = open_input(commands[i]->input_file);
                 if (fd < 0) {
                     DEBUG_PRINT("Failed to open input file\n");
                     print_error();
-                    exit(1);
+                    _exit(1);
                 }
                 if (dup2(fd, STDIN_FILENO) < 0) {
                     DEBUG_PRINT("Failed to redirect input\n");
                     print_error();
                     close(fd);
-                    exit(1);
+                    _exit(1);
                 }
                 close(fd);
                 DEBUG_PRINT("Input redirection successful\n");
@@ -287,60 +646,82 @@ void execute_pipeline(Command **commands, int num_cmds, int background) {
                 if (dup2(pipes[i % 2][1], STDOUT_FILENO) < 0) {
                     DEBUG_PRINT("Failed to setup pipe output\n");
                     print_error();
-                    exit(1);
+                    _exit(1);
                 }
-            } else if (commands[i]->output_file) {
+            } else if (commands[i]->output_file && commands[i]->redir_count == 0) {
                 // Last command output redirection
                 DEBUG_PRINTF("Setting up output redirection to %s\n", commands[i]->output_file);
-                int fd = open(commands[i]->output_file, O_WRONLY|O_CREAT|O_TRUNC, 0666);
+                int fd = cwd_openat(commands[i]->output_file, O_WRONLY|O_CREAT|O_TRUNC|O_CLOEXEC, 0666);
                 if (fd < 0 || dup2(fd, STDOUT_FILENO) < 0) {
                     DEBUG_PRINT("Failed to setup output redirection\n");
                     print_error();
-                    exit(1);
+                    _exit(1);
                 }
                 close(fd);
             }
 
             // Close all pipe fds in child
             for (int j = 0; j < 2; j++) {
-                close(pipes[j][0]);
-                close(pipes[j][1]);
+                if (pipes[j][0] >= 0) close(pipes[j][0]);
+                if (pipes[j][1] >= 0) close(pipes[j][1]);
             }
 
             // Execute the command
-            char *exec_path = search_executable(commands[i]->tokens[0]);
             if (!exec_path) {
                 DEBUG_PRINT("Command not found\n");
                 print_error();
-                exit(1);
+                _exit(1);
             }
 
-            DEBUG_PRINTF("Executing command: %s\n", exec_path);
-            execve(exec_path, commands[i]->tokens, NULL);
-            free(exec_path);
-            print_error();
-            exit(1);
+            cwd_reserve_child(commands[i]->redirs, commands[i]->redir_count);
+            apply_redirections(commands[i]->redirs, commands[i]->redir_count);
+            close_fds_except_redirections(commands[i]->redirs, commands[i]->redir_count);
+            exec_child(commands[i]->tokens, exec_path, filter, background, i);
         }
 
         // Parent process
+        TRACE(TRACE_FORK, 'E', pids[i]);
+        if (g_log_json) {
+            log_stage_spawned(i, commands[i]->tokens, exec_path, pids[i],
+                              now_seconds() - fork_start);
+        }
+        mem_free(MEM_EXEC, exec_path);
+
         // Close unused pipe ends
         if (i > 0) {
             close(pipes[(i - 1) % 2][0]);
             close(pipes[(i - 1) % 2][1]);
+            pipes[(i - 1) % 2][0] = pipes[(i - 1) % 2][1] = -1;
+        }
+    }
+
+    // A failed fork or pipe leaves earlier stages running; reap them.
+    if (started < num_cmds) {
+        if (started > 0) {
+            close(pipes[(started - 1) % 2][0]);
+            close(pipes[(started - 1) % 2][1]);
         }
+        wait_children(pids, started);
+        if (metered) meter_end(0);
+        mem_free(MEM_EXEC, pids);
+        return 1;
     }
 
-    // Wait for all processes unless in background mode
+    // Wait for all pipeline members at once unless in background mode
+    int code = 0;
     if (!background) {
         DEBUG_PRINT("Waiting for pipeline processes\n");
+        code = wait_children(pids, num_cmds);
         for (int i = 0; i < num_cmds; i++) {
-            waitpid(pids[i], NULL, 0);
+            finish_redirections(commands[i]->redirs, commands[i]->redir_count);
         }
+        if (metered) meter_end(1);
         DEBUG_PRINT("All pipeline processes completed\n");
     } else {
-        printf("[1] %d\n", pids[num_cmds-1]);
+        printf("[%d] %d\n", jobs_add(pids, num_cmds, commands[0]->tokens), pids[num_cmds-1]);
     }
 
-    free(pids);
+    mem_free(MEM_EXEC, pids);
     DEBUG_PRINT("Pipeline execution completed\n");
+    return code;
 }
\ No newline at end of file
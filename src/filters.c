@@ -0,0 +1,427 @@
+#include "shell.h"
+#include <stdint.h>
+#include <sys/stat.h>
+
+/* In-shell filters for the usual pipeline tails:
+ *
+ *   wc [-lwc]                 stdin only, output formatted like GNU wc
+ *   head [-n N | -N | -c N] [FILE]
+ *   grep [-F] [-vcq] PATTERN  stdin only, literal PATTERN
+ *
+ * A pipeline stage (or single command) whose arguments filter_supported()
+ * accepts, and whose lookup resolves to /usr/bin or /bin, is still
+ * forked, so redirections, sched/ulimit controls, stats and deadlines
+ * apply as for any other stage, but the child calls filter_run() instead
+ * of exec'ing the binary. That drops the execve(),
+ * dynamic loading and startup of the real tool, which dominate the cost
+ * of short pipelines. Anything else (other options, file arguments, a
+ * grep pattern with regex metacharacters) runs the external command, and
+ * --no-filters turns the filters off entirely.
+ *
+ * Newlines are counted 16 bytes at a time with GCC vector extensions
+ * (SSE2/NEON), and grep searches whole read buffers rather than line by
+ * line, testing 16 positions per step against the pattern's first and
+ * last bytes. head exits as soon as it has its lines, closing the
+ * pipe so the producer gets SIGPIPE instead of running to completion.
+ */
+
+#define FILTER_BUF (128 * 1024)
+
+enum { FILTER_WC = 1, FILTER_HEAD, FILTER_GREP };
+
+typedef struct FilterSpec {
+    int kind;
+    int lines, words, bytes;    // wc: counts to print
+    long long limit;            // head: lines or bytes to copy
+    int by_bytes;               // head -c
+    const char *file;           // head: input file, NULL for stdin
+    const char *pattern;        // grep: literal to find
+    int invert, count_only, quiet;
+} FilterSpec;
+
+int g_filters_enabled = 1;
+
+static int parse_count(const char *s, long long *out) {
+    char *end;
+    if (!isdigit((unsigned char)s[0])) return -1;
+    *out = strtoll(s, &end, 10);
+    return *end ? -1 : 0;
+}
+
+static int parse_wc(char **args, FilterSpec *spec) {
+    for (int i = 1; args[i]; i++) {
+        if (args[i][0] != '-' || !args[i][1]) return -1;  // File operands
+        for (const char *p = args[i] + 1; *p; p++) {
+            if (*p == 'l') spec->lines = 1;
+            else if (*p == 'w') spec->words = 1;
+            else if (*p == 'c') spec->bytes = 1;
+            else return -1;
+        }
+    }
+    if (!spec->lines && !spec->words && !spec->bytes) {
+        spec->lines = spec->words = spec->bytes = 1;
+    }
+    return 0;
+}
+
+static int parse_head(char **args, FilterSpec *spec) {
+    spec->limit = 10;
+    int i = 1;
+    if (args[i] && (strcmp(args[i], "-n") == 0 || strcmp(args[i], "-c") == 0)) {
+        if (!args[i + 1] || parse_count(args[i + 1], &spec->limit) < 0) return -1;
+        spec->by_bytes = args[i][1] == 'c';
+        i += 2;
+    } else if (args[i] && args[i][0] == '-' && args[i][1]) {
+        const char *num = args[i][1] == 'n' ? args[i] + 2 : args[i] + 1;
+        if (parse_count(num, &spec->limit) < 0) return -1;
+        i++;
+    }
+    if (args[i]) {
+        if (args[i][0] == '-' || args[i + 1]) return -1;
+        spec->file = args[i];
+    }
+    return 0;
+}
+
+static int parse_grep(char **args, FilterSpec *spec) {
+    int fixed = 0, i = 1;
+    for (; args[i] && args[i][0] == '-' && args[i][1]; i++) {
+        for (const char *p = args[i] + 1; *p; p++) {
+            if (*p == 'F') fixed = 1;
+            else if (*p == 'v') spec->invert = 1;
+            else if (*p == 'c') spec->count_only = 1;
+            else if (*p == 'q') spec->quiet = 1;
+            else return -1;
+        }
+    }
+    if (!args[i] || args[i + 1]) return -1;  // Exactly one pattern, no files
+    spec->pattern = args[i];
+    if (strchr(spec->pattern, '\n')) return -1;
+    // A basic regex without metacharacters is the same literal search.
+    if (!fixed && strpbrk(spec->pattern, ".[]*^$\\")) return -1;
+    return 0;
+}
+
+static int filter_parse(char **args, FilterSpec *spec) {
+    memset(spec, 0, sizeof(*spec));
+    if (!args || !args[0]) return -1;
+    if (strcmp(args[0], "wc") == 0) {
+        spec->kind = FILTER_WC;
+        return parse_wc(args, spec);
+    }
+    if (strcmp(args[0], "head") == 0) {
+        spec->kind = FILTER_HEAD;
+        return parse_head(args, spec);
+    }
+    if (strcmp(args[0], "grep") == 0) {
+        spec->kind = FILTER_GREP;
+        return parse_grep(args, spec);
+    }
+    return -1;
+}
+
+// The filters only stand in for the system tools: a wc in the current
+// directory or earlier on the path, or no wc at all, is left to the
+// normal exec (or its error).
+static int system_tool(const char *name, const char *exec_path) {
+    static const char *dirs[] = {"/usr/bin/", "/bin/"};
+    for (size_t i = 0; i < sizeof(dirs) / sizeof(dirs[0]); i++) {
+        size_t len = strlen(dirs[i]);
+        if (strncmp(exec_path, dirs[i], len) == 0 && strcmp(exec_path + len, name) == 0)
+            return 1;
+    }
+    return 0;
+}
+
+int filter_supported(char **args, const char *exec_path) {
+    FilterSpec spec;
+    return g_filters_enabled && exec_path && filter_parse(args, &spec) == 0 &&
+           system_tool(args[0], exec_path);
+}
+
+static ssize_t read_some(int fd, char *buf, size_t len) {
+    ssize_t n;
+    while ((n = read(fd, buf, len)) < 0 && errno == EINTR) {
+    }
+    return n;
+}
+
+static void write_all(const char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(STDOUT_FILENO, buf, len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            _exit(2);  // EPIPE with SIGPIPE ignored: the reader is gone
+        }
+        buf += n;
+        len -= (size_t)n;
+    }
+}
+
+// Output is batched so grep does not make a write() per matching line.
+static char out_buf[FILTER_BUF];
+static size_t out_len;
+
+static void flush_out(void) {
+    write_all(out_buf, out_len);
+    out_len = 0;
+}
+
+static void emit(const char *buf, size_t len) {
+    if (out_len + len > sizeof(out_buf)) {
+        flush_out();
+        if (len > sizeof(out_buf)) {
+            write_all(buf, len);
+            return;
+        }
+    }
+    memcpy(out_buf + out_len, buf, len);
+    out_len += len;
+}
+
+typedef unsigned char ByteVec __attribute__((vector_size(16)));
+
+// Count '\n' in buf, 16 bytes per step.
+static size_t count_newlines(const char *buf, size_t len) {
+    ByteVec nl;
+    memset(&nl, '\n', sizeof(nl));
+    size_t count = 0, i = 0;
+    while (len - i >= sizeof(ByteVec)) {
+        // Each lane counts up to 255 matches before it is folded.
+        ByteVec acc = {0};
+        size_t blocks = (len - i) / sizeof(ByteVec);
+        if (blocks > 255) blocks = 255;
+        for (size_t b = 0; b < blocks; b++, i += sizeof(ByteVec)) {
+            ByteVec v;
+            memcpy(&v, buf + i, sizeof(v));
+            acc -= (ByteVec)(v == nl);
+        }
+        unsigned char lanes[sizeof(ByteVec)];
+        memcpy(lanes, &acc, sizeof(lanes));
+        for (size_t l = 0; l < sizeof(lanes); l++) {
+            count += lanes[l];
+        }
+    }
+    for (; i < len; i++) {
+        count += buf[i] == '\n';
+    }
+    return count;
+}
+
+/* Find a literal in hay: compare 16 candidate positions at a time against
+ * the needle's first and last bytes, and memcmp only where both match.
+ */
+static const char *find_literal(const char *hay, size_t n, const char *pat, size_t plen) {
+    if (plen <= 1) {
+        return plen ? memchr(hay, pat[0], n) : hay;
+    }
+    ByteVec first, last;
+    memset(&first, pat[0], sizeof(first));
+    memset(&last, pat[plen - 1], sizeof(last));
+    size_t i = 0;
+    for (; i + plen - 1 + sizeof(ByteVec) <= n; i += sizeof(ByteVec)) {
+        ByteVec head, tail;
+        memcpy(&head, hay + i, sizeof(head));
+        memcpy(&tail, hay + i + plen - 1, sizeof(tail));
+        ByteVec both = (ByteVec)(head == first) & (ByteVec)(tail == last);
+        uint64_t lanes[2];
+        memcpy(lanes, &both, sizeof(lanes));
+        if (!(lanes[0] | lanes[1])) continue;
+        for (size_t l = 0; l < sizeof(ByteVec); l++) {
+            if (((unsigned char *)lanes)[l] &&
+                memcmp(hay + i + l + 1, pat + 1, plen - 2) == 0) {
+                return hay + i + l;
+            }
+        }
+    }
+    return i < n ? memmem(hay + i, n - i, pat, plen) : NULL;
+}
+
+static int number_width(const FilterSpec *spec) {
+    if (spec->lines + spec->words + spec->bytes == 1) return 1;
+    struct stat st;
+    if (fstat(STDIN_FILENO, &st) == 0 && S_ISREG(st.st_mode)) {
+        int width = 1;
+        for (long long size = st.st_size; size >= 10; size /= 10) width++;
+        return width;
+    }
+    return 7;
+}
+
+static int run_wc(const FilterSpec *spec, char *buf) {
+    unsigned long long lines = 0, words = 0, bytes = 0;
+    int in_word = 0;
+    ssize_t n;
+    while ((n = read_some(STDIN_FILENO, buf, FILTER_BUF)) > 0) {
+        bytes += (unsigned long long)n;
+        if (spec->lines) {
+            lines += count_newlines(buf, (size_t)n);
+        }
+        if (spec->words) {
+            for (ssize_t i = 0; i < n; i++) {
+                int space = isspace((unsigned char)buf[i]);
+                words += !space && !in_word;
+                in_word = !space;
+            }
+        }
+    }
+    if (n < 0) {
+        print_error();
+        return 1;
+    }
+    int width = number_width(spec);
+    const char *sep = "";
+    unsigned long long values[3] = {lines, words, bytes};
+    int shown[3] = {spec->lines, spec->words, spec->bytes};
+    char out[96];
+    int len = 0;
+    for (int i = 0; i < 3; i++) {
+        if (!shown[i]) continue;
+        len += snprintf(out + len, sizeof(out) - len, "%s%*llu", sep, width, values[i]);
+        sep = " ";
+    }
+    out[len++] = '\n';
+    write_all(out, (size_t)len);
+    return 0;
+}
+
+static int run_head(const FilterSpec *spec, char *buf) {
+    int fd = STDIN_FILENO;
+    if (spec->file) {
+        fd = open(spec->file, O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            print_error();
+            return 1;
+        }
+    }
+    long long left = spec->limit;
+    ssize_t n = 0;
+    while (left > 0 && (n = read_some(fd, buf, FILTER_BUF)) > 0) {
+        size_t take = (size_t)n;
+        if (spec->by_bytes) {
+            if ((long long)take > left) take = (size_t)left;
+            left -= (long long)take;
+        } else {
+            const char *p = buf, *end = buf + n;
+            while (left > 0 && (p = memchr(p, '\n', (size_t)(end - p))) != NULL) {
+                p++;
+                left--;
+            }
+            if (left == 0) take = (size_t)(p - buf);
+        }
+        write_all(buf, take);
+    }
+    // Returning exits the child, closing the pipe on the producer.
+    return n < 0 ? 1 : 0;
+}
+
+// Emit or count one selected line (without its newline).
+static int grep_select(const FilterSpec *spec, const char *line, size_t len,
+                       unsigned long long *matched) {
+    (*matched)++;
+    if (spec->quiet) return 1;
+    if (!spec->count_only) {
+        emit(line, len);
+        emit("\n", 1);
+    }
+    return 0;
+}
+
+/* Scan the lines in buf[0, len), each ending in '\n' except, at end of
+ * input, the last. Returns 1 when grep -q can stop.
+ */
+static int grep_lines(const FilterSpec *spec, const char *buf, size_t len,
+                      unsigned long long *matched) {
+    size_t plen = strlen(spec->pattern);
+    const char *p = buf, *end = buf + len;
+    if (spec->invert) {
+        while (p < end) {
+            const char *nl = memchr(p, '\n', (size_t)(end - p));
+            const char *eol = nl ? nl : end;
+            if (!find_literal(p, (size_t)(eol - p), spec->pattern, plen) &&
+                grep_select(spec, p, (size_t)(eol - p), matched)) {
+                return 1;
+            }
+            p = eol + 1;
+        }
+        return 0;
+    }
+    // Search the whole buffer, then widen each hit to its line.
+    const char *hit;
+    while (p < end && (hit = find_literal(p, (size_t)(end - p), spec->pattern, plen)) != NULL) {
+        const char *start = memrchr(p, '\n', (size_t)(hit - p));
+        start = start ? start + 1 : p;
+        const char *nl = memchr(hit, '\n', (size_t)(end - hit));
+        const char *eol = nl ? nl : end;
+        if (grep_select(spec, start, (size_t)(eol - start), matched)) {
+            return 1;
+        }
+        p = eol + 1;
+    }
+    return 0;
+}
+
+static int run_grep(const FilterSpec *spec, char *buf) {
+    size_t cap = FILTER_BUF, have = 0;
+    unsigned long long matched = 0;
+    int stop = 0;
+    ssize_t n;
+    for (;;) {
+        if (have == cap) {
+            // A line longer than the buffer: grow it.
+            char *grown = cap == FILTER_BUF ? malloc(cap * 2) : realloc(buf, cap * 2);
+            if (!grown) {
+                print_error();
+                return 2;
+            }
+            if (cap == FILTER_BUF) memcpy(grown, buf, have);
+            buf = grown;
+            cap *= 2;
+        }
+        n = read_some(STDIN_FILENO, buf + have, cap - have);
+        if (n <= 0) break;
+        have += (size_t)n;
+        // Only complete lines, newlines included, are scanned; the tail
+        // waits for more input.
+        const char *last = memrchr(buf, '\n', have);
+        if (!last) continue;
+        size_t complete = (size_t)(last - buf) + 1;
+        if ((stop = grep_lines(spec, buf, complete, &matched)) != 0) break;
+        have -= complete;
+        memmove(buf, last + 1, have);
+    }
+    if (n < 0) {
+        print_error();
+        return 2;
+    }
+    if (!stop && have > 0) {
+        grep_lines(spec, buf, have, &matched);
+    }
+    if (spec->count_only && !spec->quiet) {
+        char out[32];
+        int len = snprintf(out, sizeof(out), "%llu\n", matched);
+        emit(out, (size_t)len);
+    }
+    flush_out();
+    return matched > 0 ? 0 : 1;
+}
+
+/* Run a filter in the forked child, reading stdin and writing stdout.
+ * Returns the exit status.
+ */
+int filter_run(char **args) {
+    static char buf[FILTER_BUF];
+    FilterSpec spec;
+    if (filter_parse(args, &spec) < 0) {
+        print_error();
+        return 2;
+    }
+    switch (spec.kind) {
+    case FILTER_WC:
+        return run_wc(&spec, buf);
+    case FILTER_HEAD:
+        return run_head(&spec, buf);
+    default:
+        return run_grep(&spec, buf);
+    }
+}
@@ -0,0 +1,40 @@
+#ifndef GUSH_BUILTIN_H
+#define GUSH_BUILTIN_H
+
+/* Stable C ABI for native builtins loaded with "enable -f LIB NAME".
+ *
+ * A library provides one exported object per builtin, named
+ * gush_builtin_<NAME>:
+ *
+ *     #include "gush_builtin.h"
+ *
+ *     static int hello(int argc, char **argv) {
+ *         printf("hello %s\n", argc > 1 ? argv[1] : "world");
+ *         return 0;
+ *     }
+ *
+ *     const struct gush_builtin gush_builtin_hello = {
+ *         GUSH_BUILTIN_ABI, "hello", hello, "hello [NAME]"
+ *     };
+ *
+ * Build it with "cc -shared -fPIC -o hello.so hello.c". The function runs
+ * inside the shell process: argv[0] is the builtin name, argv[argc] is
+ * NULL, stdio is the shell's (redirections are not applied to builtins)
+ * and the return value becomes the exit status. It must not call exit()
+ * or keep pointers into argv after returning. The shell refuses a
+ * library whose abi field differs from the GUSH_BUILTIN_ABI it was built
+ * with; the struct only ever grows at the end.
+ */
+
+#define GUSH_BUILTIN_ABI 1
+
+typedef int (*gush_builtin_fn)(int argc, char **argv);
+
+struct gush_builtin {
+    int abi;                // GUSH_BUILTIN_ABI the library was built against
+    const char *name;       // Name the builtin is invoked as
+    gush_builtin_fn run;    // Entry point
+    const char *usage;      // One-line usage shown by "enable" (may be NULL)
+};
+
+#endif // GUSH_BUILTIN_H
@@ -8,14 +8,10 @@ static int history_index = 0;
 void add_history(const char *line) {
     if (!line) return;
     // Duplicate the command string for storage
-    char *cmd_copy = strdup(line);
-    if (!cmd_copy) {
-        print_error();
-        return;
-    }
+    char *cmd_copy = mem_strdup(MEM_HISTORY, line);
     // Free the oldest entry if needed (circular buffer)
     if (history[history_index]) {
-        free(history[history_index]);
+        mem_free(MEM_HISTORY, history[history_index]);
     }
     history[history_index] = cmd_copy;
     history_index = (history_index + 1) % HISTORY_SIZE;
@@ -35,6 +31,11 @@ void print_history() {
     }
 }
 
+// Number of the most recent command (0 before the first one).
+int history_length(void) {
+    return history_count;
+}
+
 char *get_history_command(int num) {
     if (num <= 0 || num > history_count) {
         return NULL;
@@ -61,7 +62,7 @@ char *get_history_command(int num) {
 void free_history_entries() {
     for (int i = 0; i < HISTORY_SIZE; i++) {
         if (history[i]) {
-            free(history[i]);
+            mem_free(MEM_HISTORY, history[i]);
             history[i] = NULL;
         }
     }
@@ -0,0 +1,271 @@
+#include "shell.h"
+#include <signal.h>
+
+/* Job table: background jobs and coprocesses.
+ *
+ *   cmd &                    background job, announced as "[N] PID"
+ *   coproc NAME cmd ...      start a persistent helper with two pipes
+ *   coproc --close NAME      close its stdin (it sees EOF) and forget it
+ *   jobs                     list running jobs and coprocesses
+ *   kill %N | %NAME          SIGTERM a job or coprocess
+ *
+ * A coprocess is started once through spawn_external() with its stdin and
+ * stdout connected to pipes whose other ends stay open in the shell. Later
+ * commands reach it with "%NAME" as a redirection target: "cmd > %NAME"
+ * writes a request to its stdin and "cmd < %NAME" reads its replies, so
+ * one warm process serves many requests. The helper must flush its output
+ * per reply (e.g. "sed -u"), and a reader should consume only what one
+ * request produced, since bytes read from the pipe are gone.
+ *
+ * Finished jobs are reaped with WNOHANG before each command line. A
+ * finished background job is then reported once on stderr ("Done" or
+ * "Exit N") and dropped from the table, so the table only holds live
+ * jobs. The shell's own end of a coprocess's pipes stays open until
+ * --close, so a reply written just before it exited can still be read.
+ */
+
+typedef struct Job {
+    int id;
+    pid_t *pids;        // Every process of the job (the last one reports)
+    int npids;
+    int running;        // Processes not yet reaped
+    int status;         // Exit code of the last process once it is reaped
+    char *command;
+    char *coproc;       // Coprocess name, NULL for a background job
+    int to_fd;          // Coprocess stdin (shell writes), or -1
+    int from_fd;        // Coprocess stdout (shell reads), or -1
+} Job;
+
+static Job *jobs;
+static int job_count;
+static int job_cap;
+
+static char *join_args(char **args) {
+    size_t len = 1;
+    for (int i = 0; args[i]; i++) {
+        len += strlen(args[i]) + 1;
+    }
+    char *text = mem_malloc(MEM_EXEC, len);
+    text[0] = '\0';
+    for (int i = 0; args[i]; i++) {
+        if (i > 0) strcat(text, " ");
+        strcat(text, args[i]);
+    }
+    return text;
+}
+
+static Job *new_job(pid_t *pids, int n, char *command) {
+    if (job_count == job_cap) {
+        int new_cap = job_cap ? job_cap * 2 : 8;
+        jobs = mem_realloc(MEM_EXEC, jobs, sizeof(Job) * new_cap);
+        job_cap = new_cap;
+    }
+    // Like other shells, reuse numbers once the table empties out.
+    int id = 1;
+    for (int i = 0; i < job_count; i++) {
+        if (jobs[i].id >= id) id = jobs[i].id + 1;
+    }
+    Job *job = &jobs[job_count++];
+    job->id = id;
+    job->pids = mem_malloc(MEM_EXEC, sizeof(pid_t) * n);
+    memcpy(job->pids, pids, sizeof(pid_t) * n);
+    job->npids = n;
+    job->running = n;
+    job->status = 0;
+    job->command = command;
+    job->coproc = NULL;
+    job->to_fd = job->from_fd = -1;
+    return job;
+}
+
+static void free_job(int index) {
+    Job *job = &jobs[index];
+    if (job->to_fd >= 0) close(job->to_fd);
+    if (job->from_fd >= 0) close(job->from_fd);
+    mem_free(MEM_EXEC, job->pids);
+    mem_free(MEM_EXEC, job->command);
+    mem_free(MEM_EXEC, job->coproc);
+    memmove(&jobs[index], &jobs[index + 1], sizeof(Job) * (job_count - index - 1));
+    job_count--;
+}
+
+// Track a background job; returns its job number.
+int jobs_add(pid_t *pids, int n, char **args) {
+    return new_job(pids, n, join_args(args))->id;
+}
+
+static void print_job(FILE *out, const Job *job) {
+    pid_t pid = job->pids[job->npids - 1];
+    char state[32];
+    if (job->running > 0) {
+        snprintf(state, sizeof(state), "Running");
+    } else if (job->status == 0) {
+        snprintf(state, sizeof(state), "Done");
+    } else {
+        snprintf(state, sizeof(state), "Exit %d", job->status);
+    }
+    fprintf(out, "[%d] %-8d %-10s %s%s%s\n", job->id, pid < 0 ? -pid : pid, state,
+            job->coproc ? "coproc " : "", job->coproc ? job->coproc : "",
+            job->coproc ? "" : job->command);
+}
+
+/* Reap finished background processes without blocking, then report and
+ * drop finished background jobs. Coprocesses stay until closed so their
+ * last output can still be read. Drops move table entries, so callers
+ * must not keep a Job pointer across this.
+ */
+void jobs_reap(void) {
+    for (int i = 0; i < job_count; i++) {
+        Job *job = &jobs[i];
+        for (int p = 0; p < job->npids; p++) {
+            int status;
+            if (job->pids[p] <= 0) continue;
+            pid_t done = waitpid(job->pids[p], &status, WNOHANG);
+            if (done == 0 || (done < 0 && errno == EINTR)) continue;
+            if (done > 0 && p == job->npids - 1) {
+                job->status = exit_status_code(status);
+            }
+            DEBUG_PRINTF("Reaped job %d process %d\n", job->id, job->pids[p]);
+            job->pids[p] = -job->pids[p];  // Keep it for display, marked done
+            job->running--;
+        }
+    }
+    for (int i = 0; i < job_count; i++) {
+        if (jobs[i].running == 0 && !jobs[i].coproc) {
+            fflush(stdout);
+            print_job(stderr, &jobs[i]);
+            free_job(i--);
+        }
+    }
+}
+
+static Job *find_coproc(const char *name) {
+    for (int i = 0; i < job_count; i++) {
+        if (jobs[i].coproc && strcmp(jobs[i].coproc, name) == 0) {
+            return &jobs[i];
+        }
+    }
+    return NULL;
+}
+
+/* The shell's end of a coprocess pipe: its stdin for writing, its stdout
+ * for reading. Returns -1 for an unknown name or a closed stdin.
+ */
+int coproc_fd(const char *name, int writing) {
+    Job *job = find_coproc(name);
+    if (!job) return -1;
+    return writing ? job->to_fd : job->from_fd;
+}
+
+// PID for "%N" or "%NAME" (the job's last process), or -1.
+pid_t jobs_pid(const char *spec) {
+    if (spec[0] != '%') return -1;
+    Job *job = find_coproc(spec + 1);
+    if (!job && isdigit((unsigned char)spec[1])) {
+        int id = atoi(spec + 1);
+        for (int i = 0; i < job_count; i++) {
+            if (jobs[i].id == id) job = &jobs[i];
+        }
+    }
+    if (!job || job->running == 0) return -1;
+    pid_t pid = job->pids[job->npids - 1];
+    return pid < 0 ? -pid : pid;
+}
+
+void builtin_jobs(char **args) {
+    if (args[1]) {
+        print_error();
+        return;
+    }
+    jobs_reap();
+    for (int i = 0; i < job_count; i++) {
+        print_job(stdout, &jobs[i]);
+    }
+}
+
+static int valid_name(const char *name) {
+    if (!isalpha((unsigned char)name[0]) && name[0] != '_') return 0;
+    for (const char *p = name; *p; p++) {
+        if (!isalnum((unsigned char)*p) && *p != '_') return 0;
+    }
+    return 1;
+}
+
+static void close_coproc(const char *name) {
+    Job *job = find_coproc(name);
+    if (!job) {
+        print_error();
+        return;
+    }
+    close(job->to_fd);
+    job->to_fd = -1;
+    // Give it a moment to finish on EOF; anything still running after that
+    // becomes an ordinary background job and is reaped later.
+    for (int tries = 0; tries < 50 && job->running > 0; tries++) {
+        jobs_reap();
+        job = find_coproc(name);  // The reap may have moved it
+        if (job->running > 0) usleep(2000);
+    }
+    if (job->running == 0) {
+        free_job((int)(job - jobs));
+    } else {
+        close(job->from_fd);
+        job->from_fd = -1;
+        mem_free(MEM_EXEC, job->coproc);
+        job->coproc = NULL;
+    }
+}
+
+void builtin_coproc(char **args) {
+    if (!args[1]) {
+        print_error();
+        return;
+    }
+    if (strcmp(args[1], "--close") == 0) {
+        if (!args[2] || args[3]) {
+            print_error();
+            return;
+        }
+        close_coproc(args[2]);
+        return;
+    }
+    if (!valid_name(args[1]) || !args[2]) {
+        print_error();
+        return;
+    }
+    jobs_reap();
+    Job *old = find_coproc(args[1]);
+    if (old) {
+        if (old->running > 0) {
+            print_error();  // One live coprocess per name
+            return;
+        }
+        free_job((int)(old - jobs));
+    }
+
+    int to_child[2], from_child[2];
+    if (pipe2(to_child, O_CLOEXEC) < 0) {
+        print_error();
+        return;
+    }
+    if (pipe2(from_child, O_CLOEXEC) < 0) {
+        close(to_child[0]);
+        close(to_child[1]);
+        print_error();
+        return;
+    }
+    pid_t pid = spawn_external(&args[2], to_child[0], from_child[1], -1, 1);
+    close(to_child[0]);
+    close(from_child[1]);
+    if (pid < 0) {
+        close(to_child[1]);
+        close(from_child[0]);
+        return;
+    }
+
+    Job *job = new_job(&pid, 1, join_args(&args[2]));
+    job->coproc = mem_strdup(MEM_EXEC, args[1]);
+    job->to_fd = to_child[1];
+    job->from_fd = from_child[0];
+    printf("[%d] %d\n", job->id, pid);
+}
@@ -0,0 +1,192 @@
+#include "shell.h"
+#include <signal.h>
+
+/* Resource limits for spawned commands.
+ *
+ *   ulimit [-t SECS] [-v KB] [-d KB] [-s KB] [-f KB] [-c KB] [-l KB]
+ *          [-n FILES] [-u PROCS] cmd ...      limits for this line only
+ *   ulimit OPTIONS                            default for every command
+ *   ulimit [-a]                               show the defaults
+ *
+ * Values may be "unlimited". Like the sched controls, limits are never
+ * set on the shell itself: limits_apply_child() sets them (soft and hard,
+ * with the hard CPU limit a second later so SIGXCPU arrives first) in the
+ * forked child just before execve(), with per-line values taking
+ * precedence over the defaults. When a child dies from a signal that a
+ * limit raises (SIGXCPU, SIGXFSZ, or SIGKILL at the hard CPU limit), or
+ * crashes while a memory limit is set, the limit is named on stderr.
+ */
+
+typedef struct LimitDef {
+    char flag;
+    int resource;
+    long scale;         // Bytes per unit for sizes, 1 for counts
+    const char *name;
+} LimitDef;
+
+static const LimitDef LIMITS[] = {
+    {'t', RLIMIT_CPU, 1, "cpu time (seconds)"},
+    {'v', RLIMIT_AS, 1024, "virtual memory (kbytes)"},
+    {'d', RLIMIT_DATA, 1024, "data seg size (kbytes)"},
+    {'s', RLIMIT_STACK, 1024, "stack size (kbytes)"},
+    {'f', RLIMIT_FSIZE, 1024, "file size (kbytes)"},
+    {'c', RLIMIT_CORE, 1024, "core file size (kbytes)"},
+    {'l', RLIMIT_MEMLOCK, 1024, "max locked memory (kbytes)"},
+    {'n', RLIMIT_NOFILE, 1, "open files"},
+    {'u', RLIMIT_NPROC, 1, "max user processes"},
+};
+
+#define NUM_LIMITS ((int)(sizeof(LIMITS) / sizeof(LIMITS[0])))
+_Static_assert(NUM_LIMITS == MAX_LIMITS, "LimitSpec size must match LIMITS");
+
+LimitSpec g_cmd_limits;
+static LimitSpec default_limits;
+
+static int limit_index(char flag) {
+    for (int i = 0; i < NUM_LIMITS; i++) {
+        if (LIMITS[i].flag == flag) return i;
+    }
+    return -1;
+}
+
+/* Parse "-X VALUE" pairs from args[*i] on into spec, stopping at the first
+ * token that is not an option. Returns -1 on a malformed option.
+ */
+static int parse_limit_options(char **args, int count, int *i, LimitSpec *spec) {
+    while (*i < count && args[*i][0] == '-' && args[*i][1] && !args[*i][2] &&
+           args[*i][1] != 'a') {
+        int idx = limit_index(args[*i][1]);
+        if (idx < 0 || *i + 1 >= count) return -1;
+        const char *val = args[*i + 1];
+        if (strcmp(val, "unlimited") == 0) {
+            spec->value[idx] = RLIM_INFINITY;
+        } else {
+            char *end;
+            long long n = strtoll(val, &end, 10);
+            if (end == val || *end || n < 0) return -1;
+            spec->value[idx] = (rlim_t)n * LIMITS[idx].scale;
+        }
+        spec->set[idx] = 1;
+        *i += 2;
+    }
+    return 0;
+}
+
+// Set the limits on this (child) process; exits on failure.
+void limits_apply_child(void) {
+    for (int i = 0; i < NUM_LIMITS; i++) {
+        rlim_t value;
+        if (g_cmd_limits.set[i]) {
+            value = g_cmd_limits.value[i];
+        } else if (default_limits.set[i]) {
+            value = default_limits.value[i];
+        } else {
+            continue;
+        }
+        // Raising past the hard limit needs privilege; setrlimit reports it.
+        struct rlimit rl = {value, value};
+        if (LIMITS[i].resource == RLIMIT_CPU && value != RLIM_INFINITY) {
+            rl.rlim_max = value + 1;  // SIGXCPU first, SIGKILL a second later
+        }
+        if (setrlimit(LIMITS[i].resource, &rl) != 0) {
+            DEBUG_PRINTF("ulimit -%c failed, errno: %d\n", LIMITS[i].flag, errno);
+            print_error();
+            _exit(1);
+        }
+    }
+}
+
+// Value in effect for a limit, or -1 when the shell leaves it alone.
+static int effective(int idx, rlim_t *value) {
+    if (g_cmd_limits.set[idx]) {
+        *value = g_cmd_limits.value[idx];
+    } else if (default_limits.set[idx]) {
+        *value = default_limits.value[idx];
+    } else {
+        return -1;
+    }
+    return *value == RLIM_INFINITY ? -1 : 0;
+}
+
+static void report(pid_t pid, int sig, char flag, const char *how) {
+    int idx = limit_index(flag);
+    fprintf(stderr, "gush: pid %d killed by %s: %s limit (ulimit -%c)%s\n",
+            (int)pid, strsignal(sig), LIMITS[idx].name, flag, how);
+}
+
+/* Called for every reaped child: if it died from a signal that an active
+ * limit explains, say which one.
+ */
+void limits_report(const ReapResult *res, const ProcStats *ps) {
+    if (!WIFSIGNALED(res->status)) {
+        return;
+    }
+    int sig = WTERMSIG(res->status);
+    rlim_t value;
+    if (sig == SIGXCPU && effective(limit_index('t'), &value) == 0) {
+        report(res->pid, sig, 't', "");
+    } else if (sig == SIGKILL && effective(limit_index('t'), &value) == 0 &&
+               ps->user + ps->sys >= (double)value + 0.9) {
+        report(res->pid, sig, 't', "");
+    } else if (sig == SIGXFSZ && effective(limit_index('f'), &value) == 0) {
+        report(res->pid, sig, 'f', "");
+    } else if (sig == SIGSEGV || sig == SIGBUS || sig == SIGABRT) {
+        const char memory_flags[] = {'v', 'd', 's'};
+        for (size_t i = 0; i < sizeof(memory_flags); i++) {
+            if (effective(limit_index(memory_flags[i]), &value) == 0) {
+                report(res->pid, sig, memory_flags[i], ", likely");
+                break;
+            }
+        }
+    }
+}
+
+static void print_limits(void) {
+    for (int i = 0; i < NUM_LIMITS; i++) {
+        printf("%-28s (-%c) ", LIMITS[i].name, LIMITS[i].flag);
+        if (!default_limits.set[i]) {
+            printf("inherited\n");
+        } else if (default_limits.value[i] == RLIM_INFINITY) {
+            printf("unlimited\n");
+        } else {
+            printf("%llu\n", (unsigned long long)(default_limits.value[i] / LIMITS[i].scale));
+        }
+    }
+}
+
+void run_limited(CommandList *cmdList) {
+    Command *first = cmdList->commands[0];
+    if (first->token_count == 1 ||
+        (first->token_count == 2 && strcmp(first->tokens[1], "-a") == 0)) {
+        print_limits();
+        return;
+    }
+
+    LimitSpec spec = g_cmd_limits;  // Nested prefixes refine the outer one
+    int i = 1;
+    if (parse_limit_options(first->tokens, first->token_count, &i, &spec) < 0 || i == 1) {
+        print_error();
+        return;
+    }
+
+    if (i == first->token_count) {
+        // No command: change the defaults
+        if (cmdList->count > 1) {
+            print_error();
+            return;
+        }
+        for (int idx = 0; idx < NUM_LIMITS; idx++) {
+            if (spec.set[idx]) {
+                default_limits.set[idx] = 1;
+                default_limits.value[idx] = spec.value[idx];
+            }
+        }
+        return;
+    }
+
+    LimitSpec saved = g_cmd_limits;
+    command_shift_tokens(first, i);
+    g_cmd_limits = spec;
+    run_prefixed(cmdList);
+    g_cmd_limits = saved;
+}
@@ -0,0 +1,514 @@
+#include "shell.h"
+#include <dirent.h>
+#include <limits.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <termios.h>
+
+/* Interactive line editor, used when stdin and stdout are a terminal.
+ *
+ *   Left/Right, Ctrl-B/F      move by character
+ *   Home/End, Ctrl-A/E        start / end of line
+ *   Backspace, Delete, Ctrl-D delete (Ctrl-D on an empty line is EOF)
+ *   Ctrl-K / Ctrl-U / Ctrl-W  kill to end / to start / previous word
+ *   Up/Down, Ctrl-P/N         walk the history (history.c)
+ *   Ctrl-R                    incremental search back through history;
+ *                             Ctrl-R again for an older match, Enter runs
+ *                             it, Ctrl-G cancels, anything else edits it
+ *   Tab                       complete; a second Tab lists the choices
+ *   Ctrl-C                    abandon the line, Ctrl-L clear the screen
+ *
+ * The terminal is in raw mode only while a line is being read, so commands
+ * and multi-line script blocks see the normal cooked terminal. The first
+ * word of a command completes from the executable trie (complete.c);
+ * other words, and words containing a '/', complete file names. Lines
+ * longer than the terminal scroll horizontally.
+ */
+
+#define LIST_MAX 100        // Completions shown by a second Tab
+
+typedef struct Editor {
+    char *buf;
+    size_t len;
+    size_t pos;
+    size_t cap;
+    const char *prompt;
+    size_t plen;
+} Editor;
+
+static struct termios cooked;
+
+static int enable_raw(void) {
+    if (tcgetattr(STDIN_FILENO, &cooked) != 0) {
+        return -1;
+    }
+    struct termios raw = cooked;
+    raw.c_iflag &= ~(BRKINT | ICRNL | INPCK | ISTRIP | IXON);
+    raw.c_cflag |= CS8;
+    raw.c_lflag &= ~(ECHO | ICANON | IEXTEN | ISIG);
+    raw.c_cc[VMIN] = 1;
+    raw.c_cc[VTIME] = 0;
+    return tcsetattr(STDIN_FILENO, TCSAFLUSH, &raw);
+}
+
+static void disable_raw(void) {
+    tcsetattr(STDIN_FILENO, TCSAFLUSH, &cooked);
+}
+
+static void out(const char *s, size_t n) {
+    while (n > 0) {
+        ssize_t w = write(STDOUT_FILENO, s, n);
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            return;
+        }
+        s += w;
+        n -= (size_t)w;
+    }
+}
+
+static void outs(const char *s) {
+    out(s, strlen(s));
+}
+
+static int columns(void) {
+    struct winsize ws;
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == 0 && ws.ws_col > 0) {
+        return ws.ws_col;
+    }
+    return 80;
+}
+
+// Redraw prompt + line with a window that keeps the cursor visible.
+static void refresh(Editor *e) {
+    size_t cols = (size_t)columns();
+    size_t room = cols > e->plen + 1 ? cols - e->plen - 1 : 1;
+    size_t start = e->pos > room ? e->pos - room : 0;
+    size_t shown = e->len - start < room ? e->len - start : room;
+    char seq[32];
+
+    outs("\r");
+    outs(e->prompt);
+    out(e->buf + start, shown);
+    outs("\x1b[K");
+    snprintf(seq, sizeof(seq), "\r\x1b[%zuC", e->plen + e->pos - start);
+    outs(seq);
+}
+
+static void reserve(Editor *e, size_t extra) {
+    if (e->len + extra + 1 <= e->cap) {
+        return;
+    }
+    size_t cap = e->cap ? e->cap : 128;
+    while (cap < e->len + extra + 1) cap *= 2;
+    char *grown = realloc(e->buf, cap);
+    if (!grown) {
+        print_error();
+        exit(1);
+    }
+    e->buf = grown;
+    e->cap = cap;
+}
+
+static void insert(Editor *e, const char *s, size_t n) {
+    reserve(e, n);
+    memmove(e->buf + e->pos + n, e->buf + e->pos, e->len - e->pos);
+    memcpy(e->buf + e->pos, s, n);
+    e->len += n;
+    e->pos += n;
+    e->buf[e->len] = '\0';
+}
+
+static void erase(Editor *e, size_t from, size_t to) {
+    memmove(e->buf + from, e->buf + to, e->len - to);
+    e->len -= to - from;
+    e->buf[e->len] = '\0';
+    if (e->pos > to) {
+        e->pos -= to - from;
+    } else if (e->pos > from) {
+        e->pos = from;
+    }
+}
+
+static void set_line(Editor *e, const char *s) {
+    e->len = e->pos = 0;
+    insert(e, s, strlen(s));
+}
+
+static int read_key(void) {
+    unsigned char c;
+    for (;;) {
+        ssize_t n = read(STDIN_FILENO, &c, 1);
+        if (n == 1) return c;
+        if (n < 0 && errno == EINTR) continue;
+        return -1;
+    }
+}
+
+// Keys after ESC, mapped to the control key with the same meaning.
+static int read_escape(void) {
+    int a = read_key();
+    if (a != '[' && a != 'O') return 0;
+    int b = read_key();
+    if (b >= '0' && b <= '9') {
+        int c = read_key();
+        if (c != '~') return 0;
+        switch (b) {
+        case '1': case '7': return 1;    // Home
+        case '4': case '8': return 5;    // End
+        case '3': return 127 + 256;      // Delete
+        default: return 0;
+        }
+    }
+    switch (b) {
+    case 'A': return 16;    // Up
+    case 'B': return 14;    // Down
+    case 'C': return 6;     // Right
+    case 'D': return 2;     // Left
+    case 'H': return 1;
+    case 'F': return 5;
+    default: return 0;
+    }
+}
+
+// ------------------------
+// Completion
+// ------------------------
+
+static int is_separator(char c) {
+    return c == '|' || c == ';' || c == '&';
+}
+
+static int compare_names(const void *a, const void *b) {
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+/* File names in the directory part of word that start with its last
+ * component. Directories get a trailing '/'. Returns the match count; up
+ * to max (sorted) names are stored, each malloc'd.
+ */
+static int complete_file(const char *word, char *common, size_t size, char **names, int max) {
+    const char *slash = strrchr(word, '/');
+    char dir[4096];
+    const char *base = slash ? slash + 1 : word;
+    if (slash) {
+        size_t n = (size_t)(slash - word) + 1;
+        if (n >= sizeof(dir)) return 0;
+        memcpy(dir, word, n);
+        dir[n] = '\0';
+    } else {
+        dir[0] = '\0';
+    }
+    int dfd = cwd_openat(dir[0] ? dir : ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC, 0);
+    DIR *d = dfd >= 0 ? fdopendir(dfd) : NULL;
+    if (!d) {
+        if (dfd >= 0) close(dfd);
+        return 0;
+    }
+    size_t blen = strlen(base);
+    int count = 0, kept = 0;
+    size_t common_len = 0;
+    struct dirent *ent;
+    char full[4096 + NAME_MAX + 2];
+    while ((ent = readdir(d)) != NULL) {
+        if (strncmp(ent->d_name, base, blen) != 0 ||
+            strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0 ||
+            (ent->d_name[0] == '.' && base[0] != '.')) {
+            continue;
+        }
+        struct stat st;
+        int is_dir = fstatat(dirfd(d), ent->d_name, &st, 0) == 0 && S_ISDIR(st.st_mode);
+        snprintf(full, sizeof(full), "%s%s%s", dir, ent->d_name, is_dir ? "/" : "");
+        if (count == 0) {
+            common_len = strlen(full) < size - 1 ? strlen(full) : size - 1;
+            memcpy(common, full, common_len);
+        } else {
+            size_t i = 0;
+            while (i < common_len && common[i] == full[i]) i++;
+            common_len = i;
+        }
+        count++;
+        if (names && kept < max) {
+            names[kept] = strdup(full);
+            if (names[kept]) kept++;
+        }
+    }
+    closedir(d);
+    common[common_len] = '\0';
+    if (names) qsort(names, kept, sizeof(char *), compare_names);
+    return count;
+}
+
+static void list_choices(Editor *e, char **names, int kept, int count) {
+    int cols = columns();
+    int width = 0;
+    for (int i = 0; i < kept; i++) {
+        int w = (int)strlen(names[i]);
+        if (w > width) width = w;
+    }
+    width += 2;
+    int per_row = cols / width > 0 ? cols / width : 1;
+    outs("\r\n");
+    for (int i = 0; i < kept; i++) {
+        char cell[512];
+        snprintf(cell, sizeof(cell), "%-*s", width, names[i]);
+        outs(cell);
+        if ((i + 1) % per_row == 0 || i == kept - 1) outs("\r\n");
+    }
+    if (count > kept) {
+        char more[64];
+        snprintf(more, sizeof(more), "... and %d more\r\n", count - kept);
+        outs(more);
+    }
+    refresh(e);
+}
+
+static void complete(Editor *e, int listing) {
+    size_t start = e->pos;
+    while (start > 0 && !isspace((unsigned char)e->buf[start - 1]) &&
+           !is_separator(e->buf[start - 1]) && e->buf[start - 1] != '<' &&
+           e->buf[start - 1] != '>') {
+        start--;
+    }
+    size_t before = start;
+    while (before > 0 && isspace((unsigned char)e->buf[before - 1])) before--;
+    int command = before == 0 || is_separator(e->buf[before - 1]);
+
+    char word[4096];
+    size_t wlen = e->pos - start;
+    if (wlen >= sizeof(word)) return;
+    memcpy(word, e->buf + start, wlen);
+    word[wlen] = '\0';
+
+    char common[4096];
+    char *names[LIST_MAX] = {0};
+    int count;
+    if (command && !strchr(word, '/')) {
+        complete_refresh();
+        count = complete_command(word, common, sizeof(common), listing ? names : NULL, LIST_MAX);
+    } else {
+        count = complete_file(word, common, sizeof(common), listing ? names : NULL, LIST_MAX);
+    }
+    int kept = listing ? (count < LIST_MAX ? count : LIST_MAX) : 0;
+
+    if (count == 0) {
+        outs("\a");
+    } else if (strlen(common) > wlen) {
+        insert(e, common + wlen, strlen(common) - wlen);
+        if (count == 1 && common[strlen(common) - 1] != '/') {
+            insert(e, " ", 1);
+        }
+        refresh(e);
+    } else if (count == 1) {
+        if (common[0] && common[strlen(common) - 1] != '/') insert(e, " ", 1);
+        refresh(e);
+    } else if (listing) {
+        list_choices(e, names, kept, count);
+    } else {
+        outs("\a");
+    }
+    for (int i = 0; i < kept; i++) {
+        free(names[i]);
+    }
+}
+
+// ------------------------
+// History
+// ------------------------
+
+/* Ctrl-R: search back through history for the typed text. Returns 1 to
+ * run the found line, 0 to keep editing it (the key that ended the search
+ * is consumed), -1 on EOF.
+ */
+static int search_history(Editor *e) {
+    char query[256] = "";
+    size_t qlen = 0;
+    int newest = history_length();
+    int match = 0;          // History number of the shown line, 0 = none
+    char *original = strdup(e->buf ? e->buf : "");
+    if (!original) {
+        print_error();
+        exit(1);
+    }
+
+    for (;;) {
+        const char *line = match ? get_history_command(match) : NULL;
+        char status[512];
+        snprintf(status, sizeof(status), "\r(reverse-i-search)`%s': %s\x1b[K",
+                 query, line ? line : "");
+        outs(status);
+
+        int c = read_key();
+        int from = 0;
+        if (c < 0) {
+            free(original);
+            return -1;
+        }
+        if (c == 18) {                          // Ctrl-R: next older match
+            from = match ? match - 1 : newest;
+        } else if (c == 127 || c == 8) {
+            if (qlen > 0) query[--qlen] = '\0';
+            from = newest;
+        } else if (c == 7 || c == 3) {          // Ctrl-G / Ctrl-C: cancel
+            set_line(e, original);
+            free(original);
+            refresh(e);
+            return 0;
+        } else if (c == '\r' || c == '\n') {
+            set_line(e, line ? line : original);
+            free(original);
+            return 1;
+        } else if (c >= 32 && c < 127 && qlen + 1 < sizeof(query)) {
+            query[qlen++] = (char)c;
+            query[qlen] = '\0';
+            from = match ? match : newest;
+        } else {
+            if (c == 27) read_escape();
+            set_line(e, line ? line : original);
+            free(original);
+            refresh(e);
+            return 0;
+        }
+        int found = 0;
+        for (int h = from; h > 0 && qlen > 0; h--) {
+            const char *cand = get_history_command(h);
+            if (!cand) break;  // Older entries have left the buffer
+            if (strstr(cand, query)) {
+                found = h;
+                break;
+            }
+        }
+        if (found || qlen == 0) {
+            match = found;
+        } else {
+            outs("\a");
+        }
+    }
+}
+
+/* Read one line with editing into *line (newline not included). Returns
+ * its length, or -1 at EOF.
+ */
+static ssize_t edit_line(Editor *e) {
+    int newest = history_length();
+    int current = newest + 1;   // History number being shown
+    char *draft = NULL;         // The new line, kept while browsing history
+    int last = 0;
+
+    refresh(e);
+    for (;;) {
+        int c = read_key();
+        if (c == 27) c = read_escape();
+        if (c < 0) {
+            free(draft);
+            return -1;
+        }
+        switch (c) {
+        case '\r':
+        case '\n':
+            free(draft);
+            return (ssize_t)e->len;
+        case 3:                                 // Ctrl-C
+            outs("^C");
+            e->len = e->pos = 0;
+            e->buf[0] = '\0';
+            free(draft);
+            return 0;
+        case 4:                                 // Ctrl-D
+            if (e->len == 0) {
+                free(draft);
+                return -1;
+            }
+            if (e->pos < e->len) erase(e, e->pos, e->pos + 1);
+            break;
+        case 127:
+        case 8:
+            if (e->pos > 0) erase(e, e->pos - 1, e->pos);
+            break;
+        case 127 + 256:                         // Delete
+            if (e->pos < e->len) erase(e, e->pos, e->pos + 1);
+            break;
+        case 1: e->pos = 0; break;
+        case 5: e->pos = e->len; break;
+        case 2: if (e->pos > 0) e->pos--; break;
+        case 6: if (e->pos < e->len) e->pos++; break;
+        case 11: erase(e, e->pos, e->len); break;
+        case 21: erase(e, 0, e->pos); break;
+        case 23: {                              // Ctrl-W
+            size_t p = e->pos;
+            while (p > 0 && e->buf[p - 1] == ' ') p--;
+            while (p > 0 && e->buf[p - 1] != ' ') p--;
+            erase(e, p, e->pos);
+            break;
+        }
+        case 12:                                // Ctrl-L
+            outs("\x1b[H\x1b[2J");
+            break;
+        case 16:                                // Up
+        case 14: {                              // Down
+            int next = c == 16 ? current - 1 : current + 1;
+            const char *entry = next <= newest ? get_history_command(next) : NULL;
+            if (next > newest + 1 || (next <= newest && !entry)) {
+                outs("\a");
+                break;
+            }
+            if (current == newest + 1) {
+                free(draft);
+                draft = strdup(e->buf);
+            }
+            current = next;
+            set_line(e, entry ? entry : (draft ? draft : ""));
+            break;
+        }
+        case 18: {                              // Ctrl-R
+            int rc = search_history(e);
+            if (rc != 0) {
+                free(draft);
+                return rc < 0 ? -1 : (ssize_t)e->len;
+            }
+            break;
+        }
+        case 9:
+            complete(e, last == 9);
+            break;
+        default:
+            if (c >= 32 && c < 256) {
+                char ch = (char)c;
+                insert(e, &ch, 1);
+            }
+            break;
+        }
+        last = c;
+        refresh(e);
+    }
+}
+
+// Whether interactive input should go through the editor.
+int lineedit_enabled(void) {
+    const char *term = getenv("TERM");
+    return isatty(STDIN_FILENO) && isatty(STDOUT_FILENO) &&
+           !(term && strcmp(term, "dumb") == 0);
+}
+
+/* getline() replacement for an interactive terminal: prints prompt, edits
+ * a line in raw mode and stores it (without newline) in *line, growing it
+ * as getline() would. Returns the length, or -1 at EOF.
+ */
+ssize_t lineedit_read(const char *prompt, char **line, size_t *cap) {
+    Editor e = {*line, 0, 0, *line ? *cap : 0, prompt, strlen(prompt)};
+    fflush(stdout);
+    reserve(&e, 0);
+    e.buf[0] = '\0';
+    if (enable_raw() != 0) {
+        outs(prompt);
+        *line = e.buf;
+        *cap = e.cap;
+        return getline(line, cap, stdin);
+    }
+    ssize_t n = edit_line(&e);
+    disable_raw();
+    outs("\r\n");
+    *line = e.buf;
+    *cap = e.cap;
+    return n;
+}
@@ -0,0 +1,192 @@
+#include "shell.h"
+#include <stdarg.h>
+
+/* Machine-readable execution log (--log-json FILE).
+ *
+ * One JSON object per line for every command or pipeline run by
+ * process_line(): line number, command text, per-stage argv, resolved
+ * path, pid, spawn latency, exit status and rusage. Each record is
+ * built in a heap buffer and written with a single write(2) as soon as
+ * its command finishes, so a reader tailing the file never sees half a
+ * record and nothing is left in stdio for forked children to duplicate.
+ * With the option off, every hook returns after one flag test.
+ */
+
+int g_log_json = 0;
+int g_line_number = 0;
+
+static int log_fd = -1;
+static pid_t log_owner = 0;
+static char *record = NULL;     // Record being built, reused across lines
+static size_t record_len = 0;
+static size_t record_cap = 0;
+
+// Stage details only the exec layer knows, captured at spawn time
+static struct {
+    char *json;         // Pre-rendered "argv" and "path" members
+    pid_t pid;
+    double spawn;       // Seconds the parent spent in fork()
+} stages[MAX_JOB_STAGES];
+static int stage_count = 0;
+static char *line_text = NULL;
+static double line_start = 0;
+
+// Make room for extra bytes (plus NUL) in a growing heap buffer.
+static void buf_reserve(char **buf, size_t len, size_t *cap, size_t extra) {
+    if (len + extra + 1 > *cap) {
+        *cap = (len + extra + 1) * 2;
+        *buf = mem_realloc(MEM_EXEC, *buf, *cap);
+    }
+}
+
+static void buf_append(char **buf, size_t *len, size_t *cap, const char *s) {
+    size_t n = strlen(s);
+    buf_reserve(buf, *len, cap, n);
+    memcpy(*buf + *len, s, n + 1);
+    *len += n;
+}
+
+// Append s as a JSON string literal to a growing heap buffer.
+static void json_quote(char **buf, size_t *len, size_t *cap, const char *s) {
+    buf_reserve(buf, *len, cap, strlen(s) * 6 + 2);
+    char *out = *buf + *len;
+    *out++ = '"';
+    for (const unsigned char *p = (const unsigned char *)s; *p; p++) {
+        if (*p == '"' || *p == '\\') {
+            *out++ = '\\';
+            *out++ = *p;
+        } else if (*p < 0x20) {
+            out += sprintf(out, "\\u%04x", *p);
+        } else {
+            *out++ = *p;
+        }
+    }
+    *out++ = '"';
+    *out = '\0';
+    *len = out - *buf;
+}
+
+static void log_puts(const char *s) {
+    buf_append(&record, &record_len, &record_cap, s);
+}
+
+static void log_printf(const char *fmt, ...) {
+    char tmp[512];
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(tmp, sizeof(tmp), fmt, ap);
+    va_end(ap);
+    if (n > 0) {
+        log_puts(tmp);
+    }
+}
+
+static void log_quoted(const char *s) {
+    json_quote(&record, &record_len, &record_cap, s ? s : "");
+}
+
+// Write the finished record in one write(2); O_APPEND keeps it whole.
+static void log_emit(void) {
+    size_t off = 0;
+    while (off < record_len) {
+        ssize_t n = write(log_fd, record + off, record_len - off);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        off += n;
+    }
+    record_len = 0;
+}
+
+static void log_json_close(void) {
+    if (log_fd < 0 || getpid() != log_owner) {
+        return;
+    }
+    close(log_fd);
+    log_fd = -1;
+    g_log_json = 0;
+    mem_free(MEM_EXEC, record);
+    record = NULL;
+}
+
+int log_json_open(const char *path) {
+    log_fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0666);
+    if (log_fd < 0) {
+        return -1;
+    }
+    log_owner = getpid();
+    g_log_json = 1;
+    atexit(log_json_close);
+    return 0;
+}
+
+// Start a record: keep a copy of the line before the parser mangles it.
+void log_begin_command(const char *line) {
+    if (!g_log_json) return;
+    mem_free(MEM_EXEC, line_text);
+    line_text = mem_strdup(MEM_EXEC, line);
+    stage_count = 0;
+    line_start = now_seconds();
+    g_last_job.count = 0;
+}
+
+// Called by the exec layer right after fork() for each stage.
+void log_stage_spawned(int index, char **argv, const char *path, pid_t pid, double spawn) {
+    if (!g_log_json || index < 0 || index >= MAX_JOB_STAGES) return;
+
+    char *buf = NULL;
+    size_t len = 0, cap = 0;
+    buf_append(&buf, &len, &cap, "\"argv\":[");
+    for (int i = 0; argv && argv[i]; i++) {
+        if (i > 0) {
+            buf_append(&buf, &len, &cap, ",");
+        }
+        json_quote(&buf, &len, &cap, argv[i]);
+    }
+    buf_append(&buf, &len, &cap, "],\"path\":");
+    json_quote(&buf, &len, &cap, path ? path : "");
+
+    mem_free(MEM_EXEC, stages[index].json);
+    stages[index].json = buf;
+    stages[index].pid = pid;
+    stages[index].spawn = spawn;
+    if (index >= stage_count) {
+        stage_count = index + 1;
+    }
+}
+
+// Finish the record for the command just dispatched and write it out.
+void log_end_command(int builtin, int background) {
+    if (!g_log_json) return;
+
+    record_len = 0;
+    log_printf("{\"line\":%d,\"cmd\":", g_line_number);
+    log_quoted(line_text);
+    log_printf(",\"builtin\":%s,\"background\":%s,\"status\":%d,\"wall\":%.6f,\"stages\":[",
+               builtin ? "true" : "false", background ? "true" : "false",
+               g_last_status, now_seconds() - line_start);
+
+    for (int i = 0; i < stage_count; i++) {
+        if (i > 0) log_puts(",");
+        log_puts("{");
+        log_puts(stages[i].json ? stages[i].json : "\"argv\":[],\"path\":\"\"");
+        log_printf(",\"pid\":%d,\"spawn\":%.6f", stages[i].pid, stages[i].spawn);
+        if (!background && i < g_last_job.count && g_last_job.stages[i].pid == stages[i].pid) {
+            const ProcStats *ps = &g_last_job.stages[i];
+            log_printf(",\"status\":%d,\"wall\":%.6f,\"user\":%.6f,\"sys\":%.6f,"
+                       "\"maxrss_kb\":%ld,\"nvcsw\":%ld,\"nivcsw\":%ld,"
+                       "\"inblock\":%ld,\"oublock\":%ld",
+                       ps->status, ps->wall, ps->user, ps->sys, ps->maxrss_kb,
+                       ps->nvcsw, ps->nivcsw, ps->inblock, ps->oublock);
+        }
+        log_puts("}");
+        mem_free(MEM_EXEC, stages[i].json);
+        stages[i].json = NULL;
+    }
+    log_puts("]}\n");
+    log_emit();
+    stage_count = 0;
+    mem_free(MEM_EXEC, line_text);
+    line_text = NULL;
+}
@@ -14,23 +14,9 @@ static int initialize_path(void) {
     };
     
     g_path_count = sizeof(default_paths) / sizeof(default_paths[0]);
-    g_path = malloc(sizeof(char*) * g_path_count);
-    if (!g_path) {
-        print_error();
-        return 0;
-    }
-    
+    g_path = mem_malloc(MEM_PATH, sizeof(char*) * g_path_count);
     for (int i = 0; i < g_path_count; i++) {
-        g_path[i] = strdup(default_paths[i]);
-        if (!g_path[i]) {
-            for (int j = 0; j < i; j++) {
-                free(g_path[j]);
-            }
-            free(g_path);
-            g_path = NULL;
-            print_error();
-            return 0;
-        }
+        g_path[i] = mem_strdup(MEM_PATH, default_paths[i]);
         DEBUG_PRINTF("Added path: %s\n", g_path[i]);
     }
     DEBUG_PRINT("Path initialized successfully\n");
@@ -42,78 +28,89 @@ static void cleanup_shell(char *line, FILE *input, int interactive) {
     free(line);
     free_history_entries();
     for (int i = 0; i < g_path_count; i++) {
-        free(g_path[i]);
+        mem_free(MEM_PATH, g_path[i]);
     }
-    free(g_path);
+    mem_free(MEM_PATH, g_path);
     if (!interactive && input != stdin) {
         fclose(input);
     }
     DEBUG_PRINT("Shell cleanup complete\n");
 }
 
-void process_line(char *line) {
-    DEBUG_PRINTF("Processing line: %s\n", line);
-    
-    // Skip empty lines and comments
-    if (!line || line[0] == '\0' || line[0] == '#') {
-        return;
-    }
-    
-    CommandList *cmdList = parse_line_advanced(line);
-    if (!cmdList) {
-        DEBUG_PRINT("Parsing failed\n");
-        return;
-    }
-
-    // Check if this is a pipeline (multiple commands)
-    if (cmdList->count > 1) {
-        DEBUG_PRINTF("Processing pipeline with %d commands\n", cmdList->count);
-        execute_pipeline(cmdList->commands, cmdList->count, cmdList->commands[0]->background);
-    } else if (cmdList->count == 1) {
-        Command *cmd = cmdList->commands[0];
-        if (!cmd->tokens[0]) {
-            DEBUG_PRINT("Empty command\n");
-            free_command_list(cmdList);
-            return;
-        }
-        
-        // Single command processing
-        if (is_builtin(cmd->tokens)) {
-            DEBUG_PRINT("Executing builtin command\n");
-            execute_builtin(cmd->tokens);
-        } else {
-            DEBUG_PRINT("Executing external command\n");
-            execute_external(cmd->tokens, cmd->background, 
-                           cmd->input_file, cmd->output_file);
-        }
-    }
-
-    free_command_list(cmdList);
-}
-
 int main(int argc, char *argv[]) {
     FILE *input = stdin;
     int interactive = 1;
     char *line = NULL;
     size_t len = 0;
     ssize_t read;
+    double line_timeout = 0;
+    const char *batch_file = NULL;
+    const char *checkpoint_file = NULL;
+    int resume = 0;
     
     DEBUG_PRINT("Shell starting\n");
     
     if (!initialize_path()) {
         return 1;
     }
+    cwd_dirfd();  // Opened once here, so forked children share it
+    
+    // Options come first:
+    //   gush [--line-timeout SECS] [--log-json FILE] [--trace FILE] [--no-filters]
+    //        [--meter] [--checkpoint FILE [--resume]] [batch_file]
+    //   gush --serve SOCKET
+    //   gush --client SOCKET [command ...]
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--line-timeout") == 0 && i + 1 < argc) {
+            line_timeout = atof(argv[++i]);
+            if (line_timeout <= 0) {
+                print_error();
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+            if (trace_enable_at_exit(argv[++i]) < 0) {
+                print_error();
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--log-json") == 0 && i + 1 < argc) {
+            if (log_json_open(argv[++i]) < 0) {
+                print_error();
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--no-filters") == 0) {
+            g_filters_enabled = 0;
+        } else if (strcmp(argv[i], "--meter") == 0) {
+            g_meter = 1;
+        } else if (strcmp(argv[i], "--checkpoint") == 0 && i + 1 < argc) {
+            checkpoint_file = argv[++i];
+        } else if (strcmp(argv[i], "--resume") == 0) {
+            resume = 1;
+        } else if (strcmp(argv[i], "--serve") == 0 && i + 1 < argc) {
+            return serve_main(argv[i + 1]);
+        } else if (strcmp(argv[i], "--client") == 0 && i + 1 < argc) {
+            return client_main(argv[i + 1], &argv[i + 2]);
+        } else if (!batch_file && strncmp(argv[i], "--", 2) != 0) {
+            batch_file = argv[i];
+        } else {
+            DEBUG_PRINT("Invalid or too many arguments\n");
+            print_error();
+            return 1;
+        }
+    }
     
-    if (argc > 2) {
-        DEBUG_PRINT("Too many arguments\n");
+    if (resume && !checkpoint_file) {
         print_error();
         return 1;
     }
-    
-    if (argc == 2) {
-        DEBUG_PRINTF("Opening batch file: %s\n", argv[1]);
+    if (checkpoint_file && checkpoint_open(checkpoint_file, resume) < 0) {
+        print_error();
+        return 1;
+    }
+
+    if (batch_file) {
+        DEBUG_PRINTF("Opening batch file: %s\n", batch_file);
         interactive = 0;
-        input = fopen(argv[1], "r");
+        input = fopen(batch_file, "re");
         if (!input) {
             DEBUG_PRINT("Failed to open batch file\n");
             print_error();
@@ -121,17 +118,23 @@ int main(int argc, char *argv[]) {
         }
     }
     
+    int editing = interactive && lineedit_enabled();
+
     // Main command loop
     while (1) {
-        if (interactive) {
-            printf("gush> ");
-            fflush(stdout);
+        if (editing && !script_pending()) {
+            read = lineedit_read("gush> ", &line, &len);
+        } else {
+            if (interactive) {
+                printf("gush> ");
+                fflush(stdout);
+            }
+            read = script_getline(&line, &len, input);
         }
-        
-        read = getline(&line, &len, input);
         if (read == -1) {
             break;  // End of file or error
         }
+        g_line_number++;
         
         // Remove trailing newline
         if (read > 0 && line[read - 1] == '\n') {
@@ -153,9 +156,32 @@ int main(int argc, char *argv[]) {
         if (strncmp(line, "history", 7) != 0 || (line[7] != '\0' && !isspace(line[7]))) {
             add_history(line);
         }
-        
-        process_line(line);
-        
+
+        if (g_checkpoint) {
+            // A block is checked once it has been read, in script_run_block()
+            int status;
+            checkpoint_begin(line);
+            if (!script_starts_block(line) && checkpoint_completed(&status)) {
+                // Done by an earlier run: only rebuild the state it left
+                checkpoint_replay(line);
+                g_last_status = status;
+                continue;
+            }
+        }
+
+        if (line_timeout > 0) {
+            g_line_deadline = now_seconds() + line_timeout;
+        }
+        if (script_starts_block(line)) {
+            script_run_block(line, input, interactive);
+        } else {
+            process_line(line);
+        }
+        g_line_deadline = 0;
+        if (g_checkpoint) {
+            checkpoint_end(g_last_status);
+        }
+
         if (interactive) {
             fflush(stdout);
         }
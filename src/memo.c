@@ -0,0 +1,462 @@
+#include "shell.h"
+#include <dirent.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/* memo: result memoization for deterministic commands
+ *
+ *   memo cmd [args ...] [< in] [> out]    run or replay cmd
+ *   memo --stats | --clear | --max-size BYTES
+ *
+ * The key is a 64-bit FNV-1a hash over the working directory, the argv,
+ * the resolved executable's identity (device, inode, size, mtime), the
+ * environment the child would see plus MEMO_ENV_VARS, and the identity of
+ * any "<" input file. On a hit the stored stdout and exit status are
+ * replayed without running anything; on a miss the command runs with
+ * stdout captured in a memfd, which is then stored and copied out.
+ * Stderr is never cached. Only single external commands are memoized;
+ * anything else simply runs.
+ *
+ * Entries live one per file under $GUSH_MEMO_DIR (default
+ * $HOME/.cache/gush/memo). A hit touches the entry's mtime, and after each
+ * store the least recently used entries are evicted until the directory
+ * fits the size cap.
+ */
+
+#define MEMO_DEFAULT_MAX_BYTES (64L * 1024 * 1024)
+#define MEMO_MAGIC "GUSHMEMO1"
+
+// Variables folded into the key in addition to the child's own environment
+static const char *MEMO_ENV_VARS[] = {"LANG", "LC_ALL", "TZ"};
+
+static long memo_max_bytes = MEMO_DEFAULT_MAX_BYTES;
+
+static struct {
+    long hits;
+    long misses;
+    long stores;
+    long evictions;
+    long bypassed;      // Lines under memo that could not be memoized
+    long bytes_replayed;
+} memo_stats;
+
+// ------------------------
+// Key construction
+// ------------------------
+
+#define FNV_OFFSET 14695981039346656037ull
+#define FNV_PRIME 1099511628211ull
+
+static uint64_t fnv_bytes(uint64_t h, const void *data, size_t len) {
+    const unsigned char *p = data;
+    for (size_t i = 0; i < len; i++) {
+        h ^= p[i];
+        h *= FNV_PRIME;
+    }
+    return h;
+}
+
+// Strings are hashed with their terminator so ("ab","c") != ("a","bc").
+static uint64_t fnv_str(uint64_t h, const char *s) {
+    return fnv_bytes(h, s ? s : "", s ? strlen(s) + 1 : 1);
+}
+
+static uint64_t fnv_file_identity(uint64_t h, const struct stat *st) {
+    uint64_t fields[5] = {
+        (uint64_t)st->st_dev, (uint64_t)st->st_ino, (uint64_t)st->st_size,
+        (uint64_t)st->st_mtim.tv_sec, (uint64_t)st->st_mtim.tv_nsec,
+    };
+    return fnv_bytes(h, fields, sizeof(fields));
+}
+
+// Hash everything the command's output may depend on; -1 if unmemoizable.
+static int memo_key(Command *cmd, const char *exec_path, uint64_t *key) {
+    struct stat st;
+    uint64_t h = FNV_OFFSET;
+
+    h = fnv_str(h, cwd_path());
+    for (int i = 0; i < cmd->token_count; i++) {
+        h = fnv_str(h, cmd->tokens[i]);
+    }
+
+    if (stat(exec_path, &st) != 0) {
+        return -1;
+    }
+    h = fnv_str(h, exec_path);
+    h = fnv_file_identity(h, &st);
+
+    // spawn_external() gives the child PATH=<first search dir> only
+    h = fnv_str(h, g_path_count > 0 ? g_path[0] : "");
+    for (size_t i = 0; i < sizeof(MEMO_ENV_VARS) / sizeof(MEMO_ENV_VARS[0]); i++) {
+        h = fnv_str(h, getenv(MEMO_ENV_VARS[i]));
+    }
+
+    if (cmd->input_file) {
+        if (stat(cmd->input_file, &st) != 0) {
+            return -1;
+        }
+        h = fnv_str(h, cmd->input_file);
+        h = fnv_file_identity(h, &st);
+    }
+    *key = h;
+    return 0;
+}
+
+// ------------------------
+// On-disk store
+// ------------------------
+
+static int memo_dir(char *buf, size_t size) {
+    const char *dir = getenv("GUSH_MEMO_DIR");
+    if (dir && dir[0]) {
+        snprintf(buf, size, "%s", dir);
+    } else {
+        const char *home = getenv("HOME");
+        if (!home || !home[0]) {
+            return -1;
+        }
+        snprintf(buf, size, "%s/.cache/gush/memo", home);
+    }
+    // mkdir -p
+    for (char *p = buf + 1; *p; p++) {
+        if (*p == '/') {
+            *p = '\0';
+            mkdir(buf, 0700);
+            *p = '/';
+        }
+    }
+    if (mkdir(buf, 0700) != 0 && errno != EEXIST) {
+        return -1;
+    }
+    return 0;
+}
+
+static void memo_entry_path(char *buf, size_t size, const char *dir, uint64_t key) {
+    snprintf(buf, size, "%s/%016llx", dir, (unsigned long long)key);
+}
+
+static int write_all_fd(int fd, const char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, buf, len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        buf += n;
+        len -= n;
+    }
+    return 0;
+}
+
+// Copy src (from its start) to dst; returns bytes copied or -1.
+static long copy_fd(int src, int dst, off_t offset) {
+    char buf[65536];
+    long total = 0;
+    ssize_t n;
+    while ((n = pread(src, buf, sizeof(buf), offset + total)) > 0) {
+        if (write_all_fd(dst, buf, n) < 0) {
+            return -1;
+        }
+        total += n;
+    }
+    return n < 0 ? -1 : total;
+}
+
+/* Entry layout: "GUSHMEMO1 <status> <length>\n" followed by the stdout
+ * bytes. Returns the open entry with *data_offset set, or -1 on a miss.
+ */
+static int memo_open_entry(const char *path, int *status, off_t *data_offset) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+    char header[64];
+    ssize_t n = pread(fd, header, sizeof(header) - 1, 0);
+    if (n <= 0) {
+        close(fd);
+        return -1;
+    }
+    header[n] = '\0';
+    char *nl = strchr(header, '\n');
+    long length;
+    struct stat st;
+    if (!nl || sscanf(header, MEMO_MAGIC " %d %ld", status, &length) != 2 ||
+        fstat(fd, &st) != 0 || st.st_size != (nl - header) + 1 + length) {
+        close(fd);
+        unlink(path);  // Torn or foreign entry
+        return -1;
+    }
+    *data_offset = (nl - header) + 1;
+    return fd;
+}
+
+// Write the entry to a temporary file and rename it into place.
+static int memo_store(const char *dir, const char *path, int status, int out_fd, long length) {
+    char tmp[4352];
+    snprintf(tmp, sizeof(tmp), "%s/.tmp.%d", dir, (int)getpid());
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        return -1;
+    }
+    char header[64];
+    int hlen = snprintf(header, sizeof(header), MEMO_MAGIC " %d %ld\n", status, length);
+    if (write_all_fd(fd, header, hlen) < 0 || copy_fd(out_fd, fd, 0) != length) {
+        close(fd);
+        unlink(tmp);
+        return -1;
+    }
+    close(fd);
+    if (rename(tmp, path) != 0) {
+        unlink(tmp);
+        return -1;
+    }
+    memo_stats.stores++;
+    return 0;
+}
+
+typedef struct MemoFile {
+    char name[32];
+    time_t mtime;
+    long size;
+} MemoFile;
+
+static int compare_mtime(const void *a, const void *b) {
+    const MemoFile *fa = a, *fb = b;
+    return (fa->mtime > fb->mtime) - (fa->mtime < fb->mtime);
+}
+
+// List entries; returns the count (array in *files) and total size.
+static int memo_scan(const char *dir, MemoFile **files, long *total) {
+    DIR *d = opendir(dir);
+    int count = 0, cap = 0;
+    *files = NULL;
+    *total = 0;
+    if (!d) {
+        return 0;
+    }
+    struct dirent *ent;
+    while ((ent = readdir(d)) != NULL) {
+        struct stat st;
+        if (ent->d_name[0] == '.' || strlen(ent->d_name) >= sizeof((*files)->name) ||
+            fstatat(dirfd(d), ent->d_name, &st, 0) != 0 || !S_ISREG(st.st_mode)) {
+            continue;
+        }
+        if (count == cap) {
+            cap = cap ? cap * 2 : 64;
+            MemoFile *grown = realloc(*files, sizeof(MemoFile) * cap);
+            if (!grown) break;
+            *files = grown;
+        }
+        strcpy((*files)[count].name, ent->d_name);
+        (*files)[count].mtime = st.st_mtime;
+        (*files)[count].size = st.st_size;
+        *total += st.st_size;
+        count++;
+    }
+    closedir(d);
+    return count;
+}
+
+// Evict least recently used entries until the store fits memo_max_bytes.
+static void memo_evict(const char *dir) {
+    MemoFile *files;
+    long total;
+    int count = memo_scan(dir, &files, &total);
+    if (total > memo_max_bytes) {
+        qsort(files, count, sizeof(MemoFile), compare_mtime);
+        for (int i = 0; i < count && total > memo_max_bytes; i++) {
+            char path[4352];
+            snprintf(path, sizeof(path), "%s/%s", dir, files[i].name);
+            if (unlink(path) == 0) {
+                total -= files[i].size;
+                memo_stats.evictions++;
+            }
+        }
+    }
+    free(files);
+}
+
+// ------------------------
+// Execution
+// ------------------------
+
+static int open_output(Command *cmd) {
+    if (!cmd->output_file) {
+        return STDOUT_FILENO;
+    }
+    return open(cmd->output_file, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+}
+
+// Replay a hit; returns 0 on success.
+static int memo_replay(Command *cmd, int entry_fd, off_t offset, int status) {
+    int out = open_output(cmd);
+    if (out < 0) {
+        return -1;
+    }
+    fflush(stdout);
+    long n = copy_fd(entry_fd, out, offset);
+    if (out != STDOUT_FILENO) {
+        close(out);
+    }
+    if (n < 0) {
+        return -1;
+    }
+    memo_stats.bytes_replayed += n;
+    g_last_status = status;
+    return 0;
+}
+
+// Run the command with stdout captured, store the result, then copy it out.
+static void memo_run_and_store(Command *cmd, const char *dir, const char *entry_path) {
+    int capture = memfd_create("gush-memo", MFD_CLOEXEC);
+    int in = -1;
+    if (capture < 0) {
+        print_error();
+        return;
+    }
+    if (cmd->input_file) {
+        in = open(cmd->input_file, O_RDONLY | O_CLOEXEC);
+        if (in < 0) {
+            print_error();
+            close(capture);
+            return;
+        }
+    }
+
+    fflush(stdout);
+    pid_t pid = spawn_external(cmd->tokens, in, capture, -1, 0);
+    if (in >= 0) {
+        close(in);
+    }
+    if (pid < 0) {
+        close(capture);
+        return;
+    }
+    int status = wait_children(&pid, 1);
+    long length = lseek(capture, 0, SEEK_END);
+
+    // Killed or timed-out runs are not results worth keeping
+    int signalled = g_last_job.count > 0 && g_last_job.stages[0].status > 128;
+    if (status != TIMEOUT_STATUS && !signalled && length >= 0 &&
+        length <= memo_max_bytes) {
+        if (memo_store(dir, entry_path, status, capture, length) == 0) {
+            memo_evict(dir);
+        }
+    }
+
+    int out = open_output(cmd);
+    if (out < 0 || copy_fd(capture, out, 0) < 0) {
+        print_error();
+    }
+    if (out > STDOUT_FILENO) {
+        close(out);
+    }
+    close(capture);
+    g_last_status = status;
+}
+
+static void memo_print_stats(void) {
+    char dir[4096];
+    MemoFile *files = NULL;
+    long total = 0;
+    int count = memo_dir(dir, sizeof(dir)) == 0 ? memo_scan(dir, &files, &total) : 0;
+    free(files);
+
+    long lookups = memo_stats.hits + memo_stats.misses;
+    printf("memo: %ld hits, %ld misses (%.1f%% hit rate), %ld stored, %ld evicted, "
+           "%ld bypassed\n",
+           memo_stats.hits, memo_stats.misses,
+           lookups ? 100.0 * memo_stats.hits / lookups : 0.0,
+           memo_stats.stores, memo_stats.evictions, memo_stats.bypassed);
+    printf("memo: %ld bytes replayed; store %d entries, %ld of %ld bytes\n",
+           memo_stats.bytes_replayed, count, total, memo_max_bytes);
+    fflush(stdout);
+}
+
+static void memo_clear(void) {
+    char dir[4096];
+    MemoFile *files;
+    long total;
+    if (memo_dir(dir, sizeof(dir)) != 0) {
+        print_error();
+        return;
+    }
+    int count = memo_scan(dir, &files, &total);
+    for (int i = 0; i < count; i++) {
+        char path[4352];
+        snprintf(path, sizeof(path), "%s/%s", dir, files[i].name);
+        unlink(path);
+    }
+    free(files);
+}
+
+// "memo --stats", "memo --clear", "memo --max-size BYTES"
+static void memo_option(Command *cmd) {
+    const char *opt = cmd->tokens[1];
+    if (strcmp(opt, "--stats") == 0 && cmd->token_count == 2) {
+        memo_print_stats();
+    } else if (strcmp(opt, "--clear") == 0 && cmd->token_count == 2) {
+        memo_clear();
+    } else if (strcmp(opt, "--max-size") == 0 && cmd->token_count == 3 &&
+               atol(cmd->tokens[2]) > 0) {
+        memo_max_bytes = atol(cmd->tokens[2]);
+    } else {
+        print_error();
+    }
+}
+
+void run_memoized(CommandList *cmdList) {
+    Command *cmd = cmdList->commands[0];
+    if (cmd->token_count < 2) {
+        print_error();
+        return;
+    }
+    if (strncmp(cmd->tokens[1], "--", 2) == 0) {
+        memo_option(cmd);
+        return;
+    }
+    command_shift_tokens(cmd, 1);
+
+    // Pipelines, builtins, background jobs and redirections other than a
+    // plain "> file" run normally
+    char *exec_path = NULL;
+    if (cmdList->count != 1 || cmd->background || is_builtin(cmd->tokens) ||
+        cmd->redir_count > (cmd->output_file ? 1 : 0) ||
+        !(exec_path = search_executable(cmd->tokens[0]))) {
+        memo_stats.bypassed++;
+        run_prefixed(cmdList);
+        return;
+    }
+
+    char dir[4096], entry_path[4352];
+    uint64_t key;
+    if (memo_dir(dir, sizeof(dir)) != 0 || memo_key(cmd, exec_path, &key) != 0) {
+        mem_free(MEM_EXEC, exec_path);
+        memo_stats.bypassed++;
+        run_prefixed(cmdList);
+        return;
+    }
+    mem_free(MEM_EXEC, exec_path);
+    memo_entry_path(entry_path, sizeof(entry_path), dir, key);
+
+    int status;
+    off_t offset;
+    int entry = memo_open_entry(entry_path, &status, &offset);
+    if (entry >= 0) {
+        DEBUG_PRINTF("memo hit %016llx\n", (unsigned long long)key);
+        int ok = memo_replay(cmd, entry, offset, status) == 0;
+        close(entry);
+        if (ok) {
+            memo_stats.hits++;
+            utimensat(AT_FDCWD, entry_path, NULL, 0);  // Mark recently used
+            return;
+        }
+        print_error();
+        return;
+    }
+
+    DEBUG_PRINTF("memo miss %016llx\n", (unsigned long long)key);
+    memo_stats.misses++;
+    memo_run_and_store(cmd, dir, entry_path);
+}
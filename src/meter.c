@@ -0,0 +1,214 @@
+#include "shell.h"
+#include <poll.h>
+#include <signal.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+
+/* Metered pipelines.
+ *
+ *   meter cmd1 | cmd2 | ...      meter this pipeline
+ *   gush --meter                 meter every foreground pipeline
+ *
+ * Every pipe of a metered pipeline is split in two, with a forked relay in
+ * between: the producer writes into pipe A, the relay splice()s A into B
+ * (page references move, the data is not copied), and the consumer reads
+ * B. For each pipe, the relay records three things:
+ *
+ *   bytes        bytes moved
+ *   blocked      time A was full, i.e. the producer could not write
+ *   empty        time A and B were both empty, i.e. the consumer had
+ *                nothing to read (it may be busy rather than waiting)
+ *
+ * When the pipeline finishes, these are printed to stderr after the same
+ * per-stage rusage lines "time" prints. The relay sleeps in poll() on A
+ * while A is empty and on B while A holds data. A full A or two empty
+ * pipes only change when that wakes it, so it then waits indefinitely.
+ * In between, A can fill up or B drain without waking it, so the relay
+ * looks again after METER_TICK_MS and the stall times are accurate to
+ * about a tick per state change. Background pipelines and single
+ * commands run unmetered.
+ */
+
+#define METER_TICK_MS 1
+#define METER_CHUNK (1 << 20)
+
+typedef struct MeterLink {
+    long long bytes;
+    long long splices;
+    double blocked;     // Producer blocked on a full pipe
+    double empty;       // A and B both empty
+    double active;      // Relay lifetime
+    int error;          // errno that ended the relay, 0 on EOF
+} MeterLink;
+
+int g_meter = 0;
+
+static MeterLink *links;    // Shared with the relays (MAP_SHARED)
+static size_t links_size;
+static pid_t *relays;
+static int link_count;
+
+enum { FLOWING, BLOCKED, EMPTY };
+
+static int pipe_bytes(int fd) {
+    int n = 0;
+    return ioctl(fd, FIONREAD, &n) == 0 ? n : 0;
+}
+
+static int link_state(int in, int out, int cap, int page) {
+    int queued = pipe_bytes(in);
+    if (queued > cap - page) return BLOCKED;
+    if (queued == 0 && pipe_bytes(out) == 0) return EMPTY;
+    return FLOWING;
+}
+
+// Charge the time since the last sample to the state seen then.
+static void account(MeterLink *m, double *last, int *state, int in, int out, int cap, int page) {
+    double now = now_seconds();
+    if (*state == BLOCKED) {
+        m->blocked += now - *last;
+    } else if (*state == EMPTY) {
+        m->empty += now - *last;
+    }
+    *last = now;
+    *state = link_state(in, out, cap, page);
+}
+
+// Relay process body: move in (pipe A) to out (pipe B) until EOF or EPIPE.
+static void relay(int in, int out, MeterLink *m) {
+    signal(SIGPIPE, SIG_IGN);  // A vanished consumer shows up as EPIPE
+    int cap = fcntl(in, F_GETPIPE_SZ);
+    int page = (int)sysconf(_SC_PAGESIZE);
+    if (cap <= 0) cap = 65536;
+    double begin = now_seconds();
+    double last = begin;
+    int state = link_state(in, out, cap, page);
+
+    for (;;) {
+        ssize_t n = splice(in, NULL, out, NULL, METER_CHUNK, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        account(m, &last, &state, in, out, cap, page);
+        if (n > 0) {
+            m->bytes += n;
+            m->splices++;
+            continue;
+        }
+        if (n == 0) {
+            break;  // Producer closed its end and A is drained
+        }
+        if (errno == EINTR) {
+            continue;
+        }
+        if (errno != EAGAIN) {
+            m->error = errno;
+            break;
+        }
+        // Wait for data in A while it is empty, for room in B while it is
+        // not (A is readable then, so polling it too would spin). Only a
+        // flowing link needs sampling; the other states end with a wakeup.
+        int held = pipe_bytes(in) > 0;
+        struct pollfd p[2] = {
+            {.fd = held ? -1 : in, .events = POLLIN},
+            {.fd = held ? out : -1, .events = POLLOUT},
+        };
+        poll(p, 2, state == FLOWING ? METER_TICK_MS : -1);
+    }
+    m->active = now_seconds() - begin;
+}
+
+/* Prepare to meter a pipeline with count pipes. Returns -1 (nothing to
+ * undo) if the shared record cannot be mapped.
+ */
+int meter_begin(int count) {
+    links_size = sizeof(MeterLink) * count;
+    links = mmap(NULL, links_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (links == MAP_FAILED) {
+        links = NULL;
+        return -1;
+    }
+    relays = mem_calloc(MEM_EXEC, count, sizeof(pid_t));
+    link_count = count;
+    return 0;
+}
+
+/* Put a relay on pipe index, a freshly created pipe2() pair. On success
+ * fds[1] is the producer's write end and fds[0] is the consumer's read end,
+ * now of a second pipe; the relay holds the other two ends.
+ */
+int meter_link(int index, int fds[2]) {
+    int out[2];
+    if (pipe2(out, O_CLOEXEC) < 0) {
+        return -1;
+    }
+    pid_t pid = fork();
+    if (pid < 0) {
+        close(out[0]);
+        close(out[1]);
+        return -1;
+    }
+    if (pid == 0) {
+        int keep[2] = {fds[0], out[1]};
+        close_fds_except(keep, 2);
+        relay(fds[0], out[1], &links[index]);
+        _exit(0);
+    }
+    relays[index] = pid;
+    close(fds[0]);
+    close(out[1]);
+    fds[0] = out[0];
+    return 0;
+}
+
+/* Reap the relays (their pipes are closed by now, so they are finishing)
+ * and, if report is set, print the pipe table after the stage rusage.
+ */
+void meter_end(int report) {
+    if (!links) {
+        return;
+    }
+    double relay_cpu = 0;
+    for (int i = 0; i < link_count; i++) {
+        if (relays[i] <= 0) continue;
+        int status;
+        struct rusage ru;
+        while (wait4(relays[i], &status, 0, &ru) < 0 && errno == EINTR) {
+        }
+        relay_cpu += ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1e6 +
+                     ru.ru_stime.tv_sec + ru.ru_stime.tv_usec / 1e6;
+    }
+
+    if (report) {
+        fflush(stdout);
+        print_job_stats(&g_last_job, g_last_job.wall, NULL);
+        for (int i = 0; i < link_count; i++) {
+            const MeterLink *m = &links[i];
+            double span = m->active > 0 ? m->active : 1e-9;
+            fprintf(stderr,
+                    "  pipe %d->%d: %lld bytes %.1f MB/s splices %lld blocked %.3fs (%.0f%%) "
+                    "empty %.3fs (%.0f%%)%s%s\n",
+                    i, i + 1, m->bytes, m->bytes / span / 1e6, m->splices,
+                    m->blocked, 100 * m->blocked / span, m->empty, 100 * m->empty / span,
+                    m->error ? " ended: " : "", m->error ? strerror(m->error) : "");
+        }
+        fprintf(stderr, "meter: %d relays cpu %.3fs\n", link_count, relay_cpu);
+    }
+
+    munmap(links, links_size);
+    links = NULL;
+    mem_free(MEM_EXEC, relays);
+    relays = NULL;
+    link_count = 0;
+}
+
+// "meter cmd1 | cmd2 ..." meters the pipeline on the rest of the line.
+void run_metered(CommandList *cmdList) {
+    Command *first = cmdList->commands[0];
+    if (first->token_count < 2) {
+        print_error();
+        return;
+    }
+    command_shift_tokens(first, 1);
+    int saved = g_meter;
+    g_meter = 1;
+    run_prefixed(cmdList);
+    g_meter = saved;
+}
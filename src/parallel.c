@@ -0,0 +1,226 @@
+#include "shell.h"
+#include <sys/mman.h>
+
+/* parallel: bounded-concurrency fan-out
+ *
+ *   parallel [-j N] [--pin] command [args...] ::: input1 input2 ...
+ *
+ * Runs the command once per input, substituting "{}" in the arguments
+ * (or appending the input when no "{}" is present). At most N jobs run at
+ * once; a new job starts as soon as the reaper sees one exit. Each job's
+ * stdout and stderr are captured in memory files and written out as one
+ * block when the job finishes, so output from different jobs never
+ * interleaves. A latency summary is printed to stderr at the end. With
+ * --pin, the worker in slot k is pinned to the k-th CPU the shell may use,
+ * so concurrent jobs get a core each.
+ */
+
+#define PARALLEL_DEFAULT_JOBS 4
+
+typedef struct ParallelJob {
+    pid_t pid;
+    int out_fd;         // memfd holding the job's stdout
+    int err_fd;         // memfd holding the job's stderr
+    double start;       // Spawn time (monotonic seconds)
+} ParallelJob;
+
+// Build argv for one input: replace every "{}" token, or append the input.
+static char **build_job_args(char **tmpl, int tmpl_count, char *input) {
+    char **argv = mem_malloc(MEM_EXEC, sizeof(char*) * (tmpl_count + 2));
+    int replaced = 0;
+    for (int i = 0; i < tmpl_count; i++) {
+        if (strcmp(tmpl[i], "{}") == 0) {
+            argv[i] = input;
+            replaced = 1;
+        } else {
+            argv[i] = tmpl[i];
+        }
+    }
+    int n = tmpl_count;
+    if (!replaced) {
+        argv[n++] = input;
+    }
+    argv[n] = NULL;
+    return argv;
+}
+
+// Copy a captured memfd to one of the shell's output streams.
+static void flush_capture(int fd, int target) {
+    char buf[8192];
+    ssize_t n;
+    if (lseek(fd, 0, SEEK_SET) < 0) {
+        return;
+    }
+    while ((n = read(fd, buf, sizeof(buf))) > 0) {
+        ssize_t off = 0;
+        while (off < n) {
+            ssize_t w = write(target, buf + off, n - off);
+            if (w < 0) {
+                if (errno == EINTR) continue;
+                return;
+            }
+            off += w;
+        }
+    }
+}
+
+/* A job that could not be spawned has no latency, so the percentiles
+ * cover the n jobs that ran; it still counts as a job and as a failure,
+ * and the line says how many never started.
+ */
+static void print_latency_summary(double *lat, int n, int failed, int unstarted,
+                                  double elapsed) {
+    qsort(lat, n, sizeof(double), compare_doubles);
+    fprintf(stderr,
+            "parallel: %d jobs, %d failed, %d not started, %.3fs wall; latency ms "
+            "of %d started: min %.2f p50 %.2f p90 %.2f p99 %.2f max %.2f\n",
+            n + unstarted, failed, unstarted, elapsed, n,
+            n ? lat[0] * 1000 : 0.0,
+            percentile(lat, n, 50) * 1000,
+            percentile(lat, n, 90) * 1000,
+            percentile(lat, n, 99) * 1000,
+            n ? lat[n - 1] * 1000 : 0.0);
+}
+
+void builtin_parallel(char **args) {
+    int max_jobs = PARALLEL_DEFAULT_JOBS;
+    int i = 1;
+
+    int pin = 0;
+
+    while (args[i]) {
+        if (strcmp(args[i], "-j") == 0) {
+            if (!args[i + 1] || (max_jobs = atoi(args[i + 1])) <= 0) {
+                print_error();
+                return;
+            }
+            i += 2;
+        } else if (strcmp(args[i], "--pin") == 0) {
+            pin = 1;
+            i++;
+        } else {
+            break;
+        }
+    }
+
+    // Split into command template and inputs at ":::"
+    int tmpl_start = i;
+    while (args[i] && strcmp(args[i], ":::") != 0) {
+        i++;
+    }
+    int tmpl_count = i - tmpl_start;
+    if (tmpl_count == 0 || !args[i]) {
+        print_error();
+        return;
+    }
+    char **tmpl = &args[tmpl_start];
+    char **inputs = &args[i + 1];
+    int input_count = 0;
+    while (inputs[input_count]) {
+        input_count++;
+    }
+    if (input_count == 0) {
+        return;
+    }
+    if (max_jobs > input_count) {
+        max_jobs = input_count;
+    }
+
+    Reaper reaper;
+    if (reaper_init(&reaper) < 0) {
+        print_error();
+        return;
+    }
+
+    ParallelJob *slots = mem_calloc(MEM_EXEC, max_jobs, sizeof(ParallelJob));
+    double *latencies = mem_malloc(MEM_EXEC, sizeof(double) * input_count);
+
+    // Flush anything buffered so it is not duplicated into children.
+    fflush(stdout);
+    fflush(stderr);
+
+    double begin = now_seconds();
+    int next_input = 0;
+    int running = 0;
+    int finished = 0;
+    int failed = 0;
+    int unstarted = 0;      // Spawn failures, also counted in failed
+
+    while (next_input < input_count || running > 0) {
+        // Fill every free slot before waiting.
+        while (next_input < input_count && running < max_jobs) {
+            char **job_args = build_job_args(tmpl, tmpl_count, inputs[next_input++]);
+            int out_fd = memfd_create("gush-parallel-out", MFD_CLOEXEC);
+            int err_fd = memfd_create("gush-parallel-err", MFD_CLOEXEC);
+            pid_t pid = -1;
+            if (out_fd >= 0 && err_fd >= 0) {
+                SchedSpec saved = g_cmd_sched;
+                if (pin) {
+                    // The reaper hands out the lowest free slot next
+                    int free_slot = 0;
+                    while (slots[free_slot].pid != 0) free_slot++;
+                    CPU_ZERO(&g_cmd_sched.cpus);
+                    CPU_SET(sched_nth_cpu(free_slot), &g_cmd_sched.cpus);
+                    g_cmd_sched.has_cpus = 1;
+                }
+                pid = spawn_external(job_args, -1, out_fd, err_fd, 0);
+                g_cmd_sched = saved;
+            } else {
+                print_error();
+            }
+            mem_free(MEM_EXEC, job_args);
+            if (pid < 0) {
+                if (out_fd >= 0) close(out_fd);
+                if (err_fd >= 0) close(err_fd);
+                failed++;
+                unstarted++;
+                continue;
+            }
+
+            int slot = reaper_add(&reaper, pid, active_deadline());
+            if (slot < 0) {
+                print_error();
+                exit(1);
+            }
+            // Reaper slots are reused lowest-first, so they stay below max_jobs.
+            slots[slot].pid = pid;
+            slots[slot].out_fd = out_fd;
+            slots[slot].err_fd = err_fd;
+            slots[slot].start = now_seconds();
+            running++;
+        }
+
+        if (running == 0) {
+            break;
+        }
+
+        ReapResult res;
+        int slot = reaper_next(&reaper, &res);
+        if (slot < 0) {
+            print_error();
+            break;
+        }
+        ParallelJob *job = &slots[slot];
+        latencies[finished++] = now_seconds() - job->start;
+        ProcStats ps;
+        stats_from_reap(&ps, &res);
+        stats_add_session(&ps);
+        if (ps.status != 0) {
+            failed++;
+        }
+
+        flush_capture(job->out_fd, STDOUT_FILENO);
+        flush_capture(job->err_fd, STDERR_FILENO);
+        close(job->out_fd);
+        close(job->err_fd);
+        job->pid = 0;
+        running--;
+    }
+
+    print_latency_summary(latencies, finished, failed, unstarted, now_seconds() - begin);
+    g_last_status = failed ? 1 : 0;
+
+    reaper_destroy(&reaper);
+    mem_free(MEM_EXEC, latencies);
+    mem_free(MEM_EXEC, slots);
+}
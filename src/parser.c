@@ -17,11 +17,7 @@
  */
 static char *process_token(const char *token) {
     size_t len = strlen(token);
-    char *result = malloc(len + 1);
-    if (!result) {
-        print_error();
-        exit(1);
-    }
+    char *result = mem_malloc(MEM_PARSER, len + 1);
     int ri = 0;
     int in_quote = 0;
     char quote_char = '\0';
@@ -55,7 +51,7 @@ static char *process_token(const char *token) {
  */
 static char *expand_env(const char *token) {
     if (token[0] != '$') {
-        return strdup(token);
+        return mem_strdup(MEM_PARSER, token);
     }
     // Extract variable name (alphanumeric and underscore)
     const char *p = token + 1;
@@ -69,7 +65,7 @@ static char *expand_env(const char *token) {
     char *value = getenv(varname);
     if (!value)
         value = "";
-    return strdup(value);
+    return mem_strdup(MEM_PARSER, value);
 }
 
 /* Helper: Perform a simple command substitution.
@@ -82,25 +78,21 @@ static char *expand_env(const char *token) {
 static char *command_substitute(const char *token) {
     char *start = strstr(token, "$(");
     if (!start)
-        return strdup(token);
+        return mem_strdup(MEM_PARSER, token);
     char *end = strchr(start, ')');
     if (!end)
-        return strdup(token); // No matching ')' found.
+        return mem_strdup(MEM_PARSER, token); // No matching ')' found.
     
     size_t prefix_len = start - token;
     size_t cmd_len = end - start - 2; // Exclude "$(" and ")"
-    char *cmd = malloc(cmd_len + 1);
-    if (!cmd) {
-        print_error();
-        exit(1);
-    }
+    char *cmd = mem_malloc(MEM_PARSER, cmd_len + 1);
     strncpy(cmd, start + 2, cmd_len);
     cmd[cmd_len] = '\0';
     
-    FILE *fp = popen(cmd, "r");
-    free(cmd);
+    FILE *fp = popen(cmd, "re");
+    mem_free(MEM_PARSER, cmd);
     if (!fp)
-        return strdup(token);
+        return mem_strdup(MEM_PARSER, token);
     
     char output[1024] = {0};
     size_t out_len = fread(output, 1, sizeof(output) - 1, fp);
@@ -112,11 +104,7 @@ static char *command_substitute(const char *token) {
     
     size_t suffix_len = strlen(end + 1);
     size_t new_len = prefix_len + strlen(output) + suffix_len;
-    char *new_token = malloc(new_len + 1);
-    if (!new_token) {
-        print_error();
-        exit(1);
-    }
+    char *new_token = mem_malloc(MEM_PARSER, new_len + 1);
     strncpy(new_token, token, prefix_len);
     new_token[prefix_len] = '\0';
     strcat(new_token, output);
@@ -124,30 +112,203 @@ static char *command_substitute(const char *token) {
     return new_token;
 }
 
+/* Turn one raw token into an argument the way the parser does: strip
+ * quotes and handle escapes, expand an environment variable if the token
+ * begins with '$', then run a "$(...)" command substitution.
+ */
+char *parse_word(const char *raw) {
+    char *proc = process_token(raw);
+    if (proc[0] == '$') {
+        char *expanded = expand_env(proc);
+        mem_free(MEM_PARSER, proc);
+        proc = expanded;
+    }
+    if (strstr(proc, "$(")) {
+        char *substituted = command_substitute(proc);
+        mem_free(MEM_PARSER, proc);
+        proc = substituted;
+    }
+    return proc;
+}
+
+/* Helper: parse "prealloc=SIZE,nocache" redirection options. SIZE takes
+ * an optional K, M or G suffix. Returns -1 on an unknown option.
+ */
+static int parse_redirect_options(const char *opts, Redirect *r) {
+    while (*opts) {
+        size_t n = strcspn(opts, ",");
+        if (n == 7 && strncmp(opts, "nocache", 7) == 0) {
+            r->nocache = 1;
+        } else if (n > 9 && strncmp(opts, "prealloc=", 9) == 0) {
+            char *end;
+            long long size = strtoll(opts + 9, &end, 10);
+            switch (*end) {
+            case 'K': case 'k': size <<= 10; end++; break;
+            case 'M': case 'm': size <<= 20; end++; break;
+            case 'G': case 'g': size <<= 30; end++; break;
+            }
+            if (end != opts + n || size <= 0) return -1;
+            r->prealloc = size;
+        } else {
+            return -1;
+        }
+        opts += n;
+        if (*opts == ',') opts++;
+    }
+    return 0;
+}
+
+/* Helper: recognize an output redirection operator: [N]>, [N]>>, [N]>&M,
+ * &> and &>>, optionally followed by ":options" (see above). Fills r and
+ * sets *both for &>, which also sends stderr to the file. Returns 1 for an
+ * operator, 0 for an ordinary word and -1 for a malformed operator. The
+ * target may be attached ("2>err.txt"), in which case r->path is set.
+ */
+static int parse_redirect_op(const char *tok, Redirect *r, int *both) {
+    const char *p = tok;
+    r->fd = 1;
+    r->dup_from = -1;
+    r->path = NULL;
+    r->append = 0;
+    r->prealloc = 0;
+    r->nocache = 0;
+    *both = 0;
+    if (*p == '&') {
+        *both = 1;
+        p++;
+    } else if (isdigit((unsigned char)*p)) {
+        char *end;
+        long fd = strtol(p, &end, 10);
+        if (*end != '>') return 0;
+        if (fd > 1023) return -1;
+        r->fd = (int)fd;
+        p = end;
+    }
+    if (*p != '>') return 0;
+    p++;
+    if (*p == '>') {
+        r->append = 1;
+        p++;
+    }
+    if (*p == '&' && !*both && !r->append) {
+        char *end;
+        long from = strtol(p + 1, &end, 10);
+        if (end == p + 1 || *end || from < 0 || from > 1023) return -1;
+        r->dup_from = (int)from;
+        return 1;
+    }
+    if (*p == ':') {
+        return parse_redirect_options(p + 1, r) < 0 ? -1 : 1;
+    }
+    if (*p) {
+        // Target written without a space, as in "2>err.txt"
+        r->path = mem_strdup(MEM_PARSER, p);
+    }
+    return 1;
+}
+
+static void add_redirect(Command *cmd, const Redirect *r) {
+    cmd->redirs = mem_realloc(MEM_PARSER, cmd->redirs, sizeof(Redirect) * (cmd->redir_count + 1));
+    cmd->redirs[cmd->redir_count++] = *r;
+}
+
+/* Find the ';' that ends the first command of a list, skipping quoted
+ * text, backslash escapes and "$(...)". Returns NULL if there is none.
+ */
+char *list_separator(char *line) {
+    char quote = '\0';
+    int parens = 0;
+    for (char *p = line; *p; p++) {
+        if (*p == '\\' && quote != '\'' && p[1]) {
+            p++;
+        } else if (quote) {
+            if (*p == quote) quote = '\0';
+        } else if (*p == '"' || *p == '\'') {
+            quote = *p;
+        } else if (*p == '$' && p[1] == '(') {
+            parens++;
+            p++;
+        } else if (*p == ')' && parens > 0) {
+            parens--;
+        } else if (*p == ';' && parens == 0) {
+            return p;
+        }
+    }
+    return NULL;
+}
+
+/* Helper: true if the first word of line is "bench". Its arguments are
+ * whole command lines, so the line is parsed by parse_bench_line().
+ */
+static int is_bench_line(const char *line) {
+    while (isspace((unsigned char)*line)) line++;
+    return strncmp(line, "bench", 5) == 0 &&
+           (line[5] == '\0' || isspace((unsigned char)line[5]));
+}
+
+/* Helper: split a "bench" line into words without splitting on ';' or '|'.
+ * Words end at whitespace outside quotes and are kept exactly as written,
+ * quotes included; builtin_bench() decides what to unquote.
+ */
+static CommandList *parse_bench_line(const char *line) {
+    Command *cmd = mem_calloc(MEM_PARSER, 1, sizeof(Command));
+    cmd->tokens = mem_malloc(MEM_PARSER, sizeof(char*) * MAX_TOKENS);
+    const char *p = line;
+    while (cmd->token_count < MAX_TOKENS - 1) {
+        while (isspace((unsigned char)*p)) p++;
+        if (!*p) break;
+        const char *start = p;
+        char quote = '\0';
+        for (; *p && (quote || !isspace((unsigned char)*p)); p++) {
+            if (*p == '\\' && quote != '\'' && p[1]) {
+                p++;
+            } else if (quote && *p == quote) {
+                quote = '\0';
+            } else if (!quote && (*p == '"' || *p == '\'')) {
+                quote = *p;
+            }
+        }
+        char *word = mem_malloc(MEM_PARSER, p - start + 1);
+        memcpy(word, start, p - start);
+        word[p - start] = '\0';
+        cmd->tokens[cmd->token_count++] = word;
+    }
+    cmd->tokens[cmd->token_count] = NULL;
+
+    CommandList *cmd_list = mem_malloc(MEM_PARSER, sizeof(CommandList));
+    cmd_list->commands = mem_malloc(MEM_PARSER, sizeof(Command*));
+    cmd_list->commands[0] = cmd;
+    cmd_list->count = 1;
+    return cmd_list;
+}
+
 /* Advanced parser: parse_line_advanced()
  * Implements:
  * - Splitting by semicolons (multiple commands)
  * - Splitting each command by pipe (pipeline segments)
  * - Tokenizing each command segment with advanced quote/escape handling
  * - Environment variable expansion and command substitution on tokens
- * - Detection of background operator (&), input redirection (<), and output redirection (>)
+ * - Detection of background operator (&), input redirection (<), and output
+ *   redirection (>, >>, 2>, 2>&1, &>, N>; see parse_redirect_op)
+ * - "bench" lines, which are split into words only (see parse_bench_line)
  */
 CommandList *parse_line_advanced(char *line) {
-    CommandList *cmd_list = malloc(sizeof(CommandList));
-    if (!cmd_list) {
-        print_error();
-        exit(1);
+    if (is_bench_line(line)) {
+        return parse_bench_line(line);
     }
+    CommandList *cmd_list = mem_malloc(MEM_PARSER, sizeof(CommandList));
     cmd_list->commands = NULL;
     cmd_list->count = 0;
     
-    // Split input by semicolons for multiple commands.
-    char *cmd_str = strtok(line, ";");
+    // Split input by semicolons for multiple commands. Each level keeps its
+    // own strtok_r() state so the inner splits do not end the outer loop.
+    char *list_save, *pipe_save, *word_save;
+    char *cmd_str = strtok_r(line, ";", &list_save);
     while (cmd_str) {
         // Trim leading whitespace.
         while (isspace(*cmd_str)) cmd_str++;
         if (*cmd_str == '\0') {
-            cmd_str = strtok(NULL, ";");
+            cmd_str = strtok_r(NULL, ";", &list_save);
             continue;
         }
         
@@ -160,96 +321,98 @@ CommandList *parse_line_advanced(char *line) {
         }
         
         // Split the command by pipe '|' to create pipeline segments.
-        char **pipe_segments = malloc(sizeof(char*) * MAX_TOKENS);
-        if (!pipe_segments) {
-            print_error();
-            exit(1);
-        }
+        char **pipe_segments = mem_malloc(MEM_PARSER, sizeof(char*) * MAX_TOKENS);
         int seg_count = 0;
-        char *segment = strtok(cmd_str, "|");
+        char *segment = strtok_r(cmd_str, "|", &pipe_save);
         while (segment && seg_count < MAX_TOKENS) {
             // Trim leading whitespace from each segment.
             while (isspace(*segment)) segment++;
             pipe_segments[seg_count++] = segment;
-            segment = strtok(NULL, "|");
+            segment = strtok_r(NULL, "|", &pipe_save);
         }
         
         // For each pipeline segment, tokenize into arguments.
         for (int s = 0; s < seg_count; s++) {
-            Command *cmd = malloc(sizeof(Command));
-            if (!cmd) {
-                print_error();
-                exit(1);
-            }
+            Command *cmd = mem_malloc(MEM_PARSER, sizeof(Command));
             cmd->background = background;
             cmd->input_file = NULL;
             cmd->output_file = NULL;
-            cmd->tokens = malloc(sizeof(char*) * MAX_TOKENS);
-            if (!cmd->tokens) {
-                print_error();
-                exit(1);
-            }
+            cmd->redirs = NULL;
+            cmd->redir_count = 0;
+            cmd->tokens = mem_malloc(MEM_PARSER, sizeof(char*) * MAX_TOKENS);
             cmd->token_count = 0;
             
             // Tokenize the segment by whitespace.
-            char *raw_token = strtok(pipe_segments[s], " \t\r\n");
+            Redirect redir;
+            int is_redirect, both;
+            char *raw_token = strtok_r(pipe_segments[s], " \t\r\n", &word_save);
             while (raw_token && cmd->token_count < MAX_TOKENS - 1) {
-                // Process the token: strip quotes and handle escapes.
-                char *proc = process_token(raw_token);
-                // Expand environment variables if token begins with '$'.
-                if (proc[0] == '$') {
-                    char *expanded = expand_env(proc);
-                    free(proc);
-                    proc = expanded;
-                }
-                // Perform command substitution if token contains "$(".
-                if (strstr(proc, "$(")) {
-                    char *substituted = command_substitute(proc);
-                    free(proc);
-                    proc = substituted;
-                }
+                char *proc = parse_word(raw_token);
                 
                 // Check for redirection operators.
                 if (strcmp(proc, "<") == 0) {
-                    raw_token = strtok(NULL, " \t\r\n");
+                    mem_free(MEM_PARSER, proc);
+                    raw_token = strtok_r(NULL, " \t\r\n", &word_save);
                     if (!raw_token) {
                         print_error();
                         break;
                     }
-                    char *in_tok = process_token(raw_token);
-                    cmd->input_file = in_tok;
-                    free(proc);
-                } else if (strcmp(proc, ">") == 0) {
-                    raw_token = strtok(NULL, " \t\r\n");
-                    if (!raw_token) {
+                    // A later "<" replaces an earlier one
+                    mem_free(MEM_PARSER, cmd->input_file);
+                    cmd->input_file = process_token(raw_token);
+                } else if ((is_redirect = parse_redirect_op(proc, &redir, &both)) != 0) {
+                    mem_free(MEM_PARSER, proc);
+                    if (is_redirect < 0) {
+                        // Malformed operator: drop the whole command.
                         print_error();
+                        for (int t = 0; t < cmd->token_count; t++) {
+                            mem_free(MEM_PARSER, cmd->tokens[t]);
+                        }
+                        cmd->token_count = 0;
+                        while (strtok_r(NULL, " \t\r\n", &word_save)) {
+                        }
                         break;
                     }
-                    char *out_tok = process_token(raw_token);
-                    cmd->output_file = out_tok;
-                    free(proc);
+                    if (redir.dup_from < 0 && !redir.path) {
+                        raw_token = strtok_r(NULL, " \t\r\n", &word_save);
+                        if (!raw_token) {
+                            print_error();
+                            break;
+                        }
+                        redir.path = process_token(raw_token);
+                    }
+                    add_redirect(cmd, &redir);
+                    if (both) {
+                        Redirect dup = {2, 1, NULL, 0, 0, 0};
+                        add_redirect(cmd, &dup);
+                    } else if (redir.fd == 1 && redir.path && redir.path[0] != '%' &&
+                               !redir.append && !redir.prealloc && !redir.nocache) {
+                        // Plain "> file" is also kept for consumers that only
+                        // understand a single stdout file (memo, old callers).
+                        mem_free(MEM_PARSER, cmd->output_file);
+                        cmd->output_file = mem_strdup(MEM_PARSER, redir.path);
+                    } else if (redir.fd == 1 && cmd->output_file) {
+                        mem_free(MEM_PARSER, cmd->output_file);
+                        cmd->output_file = NULL;
+                    }
                 } else if (strcmp(proc, "&") == 0) {
                     // If found within a pipeline segment, mark as background.
                     cmd->background = 1;
-                    free(proc);
+                    mem_free(MEM_PARSER, proc);
                 } else {
                     // Regular token: store it.
                     cmd->tokens[cmd->token_count++] = proc;
                 }
-                raw_token = strtok(NULL, " \t\r\n");
+                raw_token = strtok_r(NULL, " \t\r\n", &word_save);
             }
             cmd->tokens[cmd->token_count] = NULL;
             // Add this command to the CommandList.
             cmd_list->count++;
-            cmd_list->commands = realloc(cmd_list->commands, sizeof(Command*) * cmd_list->count);
-            if (!cmd_list->commands) {
-                print_error();
-                exit(1);
-            }
+            cmd_list->commands = mem_realloc(MEM_PARSER, cmd_list->commands, sizeof(Command*) * cmd_list->count);
             cmd_list->commands[cmd_list->count - 1] = cmd;
         }
-        free(pipe_segments);
-        cmd_str = strtok(NULL, ";");
+        mem_free(MEM_PARSER, pipe_segments);
+        cmd_str = strtok_r(NULL, ";", &list_save);
     }
     return cmd_list;
 }
@@ -260,16 +423,31 @@ void free_command(Command *cmd) {
     if (cmd->tokens) {
         for (int i = 0; i < cmd->token_count; i++) {
             if (cmd->tokens[i]) {
-                free(cmd->tokens[i]);
+                mem_free(MEM_PARSER, cmd->tokens[i]);
             }
         }
-        free(cmd->tokens);
+        mem_free(MEM_PARSER, cmd->tokens);
     }
     if (cmd->input_file)
-        free(cmd->input_file);
+        mem_free(MEM_PARSER, cmd->input_file);
     if (cmd->output_file)
-        free(cmd->output_file);
-    free(cmd);
+        mem_free(MEM_PARSER, cmd->output_file);
+    for (int i = 0; i < cmd->redir_count; i++) {
+        mem_free(MEM_PARSER, cmd->redirs[i].path);
+    }
+    mem_free(MEM_PARSER, cmd->redirs);
+    mem_free(MEM_PARSER, cmd);
+}
+
+// Drop the first n tokens of a command (used by prefix builtins like "timeout").
+void command_shift_tokens(Command *cmd, int n) {
+    if (!cmd || n <= 0) return;
+    if (n > cmd->token_count) n = cmd->token_count;
+    for (int i = 0; i < n; i++) {
+        mem_free(MEM_PARSER, cmd->tokens[i]);
+    }
+    memmove(cmd->tokens, cmd->tokens + n, sizeof(char*) * (cmd->token_count - n + 1));
+    cmd->token_count -= n;
 }
 
 // Free an entire CommandList.
@@ -278,20 +456,15 @@ void free_command_list(CommandList *cmd_list) {
     for (int i = 0; i < cmd_list->count; i++) {
         free_command(cmd_list->commands[i]);
     }
-    free(cmd_list->commands);
-    free(cmd_list);
+    mem_free(MEM_PARSER, cmd_list->commands);
+    mem_free(MEM_PARSER, cmd_list);
 }
 
 // Basic parser implementation
 char **parse_line(char *line, int *background, char **input_file, char **output_file, int *pipe_count) {
     DEBUG_PRINTF("\nParsing line: %s\n", line);
 
-    char **tokens = malloc(sizeof(char*) * MAX_ARGS);
-    if (!tokens) {
-        DEBUG_PRINT("Token allocation failed\n");
-        print_error();
-        exit(1);
-    }
+    char **tokens = mem_malloc(MEM_PARSER, sizeof(char*) * MAX_ARGS);
 
     // Initialize flags
     *background = 0;
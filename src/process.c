@@ -0,0 +1,162 @@
+#include "shell.h"
+
+// Run a parsed line: a pipeline, or a single built-in/external command.
+static void dispatch_command_list(CommandList *cmdList) {
+    // Check if this is a pipeline (multiple commands)
+    if (cmdList->count > 1) {
+        DEBUG_PRINTF("Processing pipeline with %d commands\n", cmdList->count);
+        g_last_status = execute_pipeline(cmdList->commands, cmdList->count,
+                                         cmdList->commands[0]->background);
+    } else if (cmdList->count == 1) {
+        Command *cmd = cmdList->commands[0];
+        if (!cmd->tokens[0]) {
+            DEBUG_PRINT("Empty command\n");
+            return;
+        }
+        
+        // Single command processing
+        if (is_builtin(cmd->tokens)) {
+            DEBUG_PRINT("Executing builtin command\n");
+            g_last_status = 0;
+            TRACE(TRACE_BUILTIN, 'B', 0);
+            execute_builtin(cmd->tokens);
+            TRACE(TRACE_BUILTIN, 'E', g_last_status);
+        } else {
+            DEBUG_PRINT("Executing external command\n");
+            g_last_status = execute_external(cmd->tokens, cmd->background,
+                                             cmd->input_file, cmd->output_file,
+                                             cmd->redirs, cmd->redir_count);
+        }
+    }
+}
+
+/* "timeout SECS cmd ..." bounds everything after it on the line, including
+ * a whole pipeline. On expiry the children get SIGTERM, then SIGKILL, and
+ * the status is TIMEOUT_STATUS.
+ */
+static void run_with_timeout(CommandList *cmdList) {
+    Command *first = cmdList->commands[0];
+    double secs = first->token_count > 1 ? atof(first->tokens[1]) : 0;
+    if (secs <= 0 || first->token_count < 3) {
+        print_error();
+        return;
+    }
+    command_shift_tokens(first, 2);
+
+    double saved = g_cmd_deadline;
+    double deadline = now_seconds() + secs;
+    if (saved == 0 || deadline < saved) {
+        g_cmd_deadline = deadline;
+    }
+    run_prefixed(cmdList);
+    g_cmd_deadline = saved;
+}
+
+// "time cmd ..." reports wall, CPU and rusage of the rest of the line.
+static void run_timed(CommandList *cmdList) {
+    Command *first = cmdList->commands[0];
+    if (first->token_count < 2) {
+        print_error();
+        return;
+    }
+    command_shift_tokens(first, 1);
+
+    struct rusage self_before, self_after, self_delta;
+    getrusage(RUSAGE_SELF, &self_before);
+    g_last_job.count = 0;
+    double begin = now_seconds();
+    run_prefixed(cmdList);
+    double wall = now_seconds() - begin;
+    getrusage(RUSAGE_SELF, &self_after);
+
+    memset(&self_delta, 0, sizeof(self_delta));
+    timersub(&self_after.ru_utime, &self_before.ru_utime, &self_delta.ru_utime);
+    timersub(&self_after.ru_stime, &self_before.ru_stime, &self_delta.ru_stime);
+    self_delta.ru_nvcsw = self_after.ru_nvcsw - self_before.ru_nvcsw;
+    self_delta.ru_nivcsw = self_after.ru_nivcsw - self_before.ru_nivcsw;
+    self_delta.ru_inblock = self_after.ru_inblock - self_before.ru_inblock;
+    self_delta.ru_oublock = self_after.ru_oublock - self_before.ru_oublock;
+    fflush(stdout);
+    print_job_stats(&g_last_job, wall, &self_delta);
+}
+
+// Peel off prefix builtins ("timeout", "time", "memo", "sched", "ulimit",
+// "meter"), which may be nested.
+void run_prefixed(CommandList *cmdList) {
+    const char *first = cmdList->count > 0 ? cmdList->commands[0]->tokens[0] : NULL;
+    if (first && strcmp(first, "timeout") == 0) {
+        run_with_timeout(cmdList);
+    } else if (first && strcmp(first, "time") == 0) {
+        run_timed(cmdList);
+    } else if (first && strcmp(first, "memo") == 0) {
+        run_memoized(cmdList);
+    } else if (first && strcmp(first, "sched") == 0) {
+        run_scheduled(cmdList);
+    } else if (first && strcmp(first, "ulimit") == 0) {
+        run_limited(cmdList);
+    } else if (first && strcmp(first, "meter") == 0) {
+        run_metered(cmdList);
+    } else {
+        dispatch_command_list(cmdList);
+    }
+}
+
+static int depth = 0;  // Nested calls (e.g. "!2") log as part of their caller
+
+/* Run an already parsed line. process_line() and the script VM (which
+ * parses loop bodies once) both come through here.
+ */
+void run_command_list(const char *line, CommandList *cmdList) {
+    int log_this = g_log_json && depth == 0;
+    if (log_this) {
+        log_begin_command(line);
+    }
+
+    TRACE(TRACE_LINE, 'B', g_line_number);
+    jobs_reap();
+    stats_count_command();
+    depth++;
+    run_prefixed(cmdList);
+    depth--;
+
+    if (log_this) {
+        int builtin = cmdList->count == 1 && is_builtin(cmdList->commands[0]->tokens);
+        log_end_command(builtin, cmdList->count > 0 && cmdList->commands[0]->background);
+    }
+    TRACE(TRACE_LINE, 'E', g_last_status);
+}
+
+void process_line(char *line) {
+    DEBUG_PRINTF("Processing line: %s\n", line);
+    
+    // Skip empty lines and comments
+    if (!line || line[0] == '\0' || line[0] == '#') {
+        return;
+    }
+
+    // "a; b" runs a, then b, each as a line of its own
+    char *semi = list_separator(line);
+    if (semi) {
+        *semi = '\0';
+        char *rest = semi + 1;
+        while (isspace((unsigned char)*rest)) rest++;
+        process_line(line);
+        process_line(rest);
+        return;
+    }
+
+    // Logged text must be copied before the parser tokenizes line in place
+    char *text = g_log_json && depth == 0 ? mem_strdup(MEM_EXEC, line) : NULL;
+    TRACE(TRACE_PARSE, 'B', 0);
+    CommandList *cmdList = parse_line_advanced(line);
+    TRACE(TRACE_PARSE, 'E', cmdList ? cmdList->count : -1);
+    if (!cmdList) {
+        DEBUG_PRINT("Parsing failed\n");
+        mem_free(MEM_EXEC, text);
+        return;
+    }
+
+    run_command_list(text ? text : line, cmdList);
+    mem_free(MEM_EXEC, text);
+    free_command_list(cmdList);
+}
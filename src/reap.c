@@ -0,0 +1,309 @@
+#include "shell.h"
+#include <sys/epoll.h>
+#include <sys/syscall.h>
+#include <sys/timerfd.h>
+#include <signal.h>
+#include <stdint.h>
+
+// epoll data value reserved for the deadline timer
+#define TIMER_SLOT UINT32_MAX
+
+double g_line_deadline = 0;
+double g_cmd_deadline = 0;
+
+// Open a pidfd for a child. Returns -1 (errno set) on kernels without pidfd.
+int pidfd_open_pid(pid_t pid) {
+#ifdef SYS_pidfd_open
+    return (int)syscall(SYS_pidfd_open, pid, 0);
+#else
+    (void)pid;
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+// Earliest of the line and command deadlines (0 = unbounded)
+double active_deadline(void) {
+    if (g_line_deadline > 0 && g_cmd_deadline > 0) {
+        return g_line_deadline < g_cmd_deadline ? g_line_deadline : g_cmd_deadline;
+    }
+    return g_line_deadline > 0 ? g_line_deadline : g_cmd_deadline;
+}
+
+int reaper_init(Reaper *r) {
+    r->epfd = epoll_create1(EPOLL_CLOEXEC);
+    r->timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+    r->watches = NULL;
+    r->capacity = 0;
+    r->count = 0;
+    if (r->epfd < 0 || r->timerfd < 0) {
+        DEBUG_PRINT("epoll/timerfd creation failed\n");
+        if (r->epfd >= 0) close(r->epfd);
+        if (r->timerfd >= 0) close(r->timerfd);
+        r->epfd = r->timerfd = -1;
+        return -1;
+    }
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.u32 = TIMER_SLOT;
+    if (epoll_ctl(r->epfd, EPOLL_CTL_ADD, r->timerfd, &ev) < 0) {
+        reaper_destroy(r);
+        return -1;
+    }
+    return 0;
+}
+
+/* Start watching a child. deadline is an absolute CLOCK_MONOTONIC time
+ * (0 = none) after which the child gets SIGTERM, then SIGKILL after
+ * TIMEOUT_KILL_GRACE seconds. Returns the slot index, or -1 on failure.
+ */
+int reaper_add(Reaper *r, pid_t pid, double deadline) {
+    int slot = -1;
+    for (int i = 0; i < r->capacity; i++) {
+        if (r->watches[i].pid == 0) {
+            slot = i;
+            break;
+        }
+    }
+    if (slot < 0) {
+        int new_cap = r->capacity ? r->capacity * 2 : 8;
+        ReapWatch *grown = realloc(r->watches, sizeof(ReapWatch) * new_cap);
+        if (!grown) {
+            return -1;
+        }
+        for (int i = r->capacity; i < new_cap; i++) {
+            grown[i].pid = 0;
+            grown[i].pidfd = -1;
+            grown[i].deadline = 0;
+            grown[i].signalled = 0;
+        }
+        slot = r->capacity;
+        r->watches = grown;
+        r->capacity = new_cap;
+    }
+
+    ReapWatch *w = &r->watches[slot];
+    w->pid = pid;
+    w->start = now_seconds();
+    w->deadline = deadline;
+    w->signalled = 0;
+    w->pidfd = pidfd_open_pid(pid);
+    if (w->pidfd >= 0) {
+        struct epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.u32 = (uint32_t)slot;
+        if (epoll_ctl(r->epfd, EPOLL_CTL_ADD, w->pidfd, &ev) < 0) {
+            close(w->pidfd);
+            w->pidfd = -1;
+        }
+    }
+    if (w->pidfd < 0) {
+        // Deadlines cannot be enforced without a pidfd to wait on.
+        DEBUG_PRINTF("No pidfd for %d, falling back to waitpid\n", pid);
+    }
+    r->count++;
+    return slot;
+}
+
+static void reaper_release(Reaper *r, int slot) {
+    ReapWatch *w = &r->watches[slot];
+    if (w->pidfd >= 0) {
+        epoll_ctl(r->epfd, EPOLL_CTL_DEL, w->pidfd, NULL);
+        close(w->pidfd);
+    }
+    w->pid = 0;
+    w->pidfd = -1;
+    r->count--;
+}
+
+// Arm the timer for the earliest pending deadline, or disarm it.
+static void reaper_arm_timer(Reaper *r) {
+    double earliest = 0;
+    for (int i = 0; i < r->capacity; i++) {
+        double d = r->watches[i].deadline;
+        if (r->watches[i].pid != 0 && d > 0 && (earliest == 0 || d < earliest)) {
+            earliest = d;
+        }
+    }
+    struct itimerspec its;
+    memset(&its, 0, sizeof(its));
+    if (earliest > 0) {
+        its.it_value.tv_sec = (time_t)earliest;
+        its.it_value.tv_nsec = (long)((earliest - (double)its.it_value.tv_sec) * 1e9);
+        if (its.it_value.tv_sec == 0 && its.it_value.tv_nsec == 0) {
+            its.it_value.tv_nsec = 1;  // A zero value would disarm the timer
+        }
+    }
+    timerfd_settime(r->timerfd, TFD_TIMER_ABSTIME, &its, NULL);
+}
+
+// Escalate every child whose deadline has passed: SIGTERM, then SIGKILL.
+static void reaper_expire(Reaper *r) {
+    uint64_t ticks;
+    while (read(r->timerfd, &ticks, sizeof(ticks)) > 0) {
+    }
+    double now = now_seconds();
+    for (int i = 0; i < r->capacity; i++) {
+        ReapWatch *w = &r->watches[i];
+        if (w->pid == 0 || w->deadline <= 0 || w->deadline > now) {
+            continue;
+        }
+        if (w->signalled == 0) {
+            DEBUG_PRINTF("Deadline hit for %d, sending SIGTERM\n", w->pid);
+            kill(w->pid, SIGTERM);
+            w->signalled = 1;
+            w->deadline = now + TIMEOUT_KILL_GRACE;
+        } else {
+            DEBUG_PRINTF("Grace period over for %d, sending SIGKILL\n", w->pid);
+            kill(w->pid, SIGKILL);
+            w->signalled = 2;
+            w->deadline = 0;
+        }
+    }
+}
+
+/* Block until one watched child exits and reap it. Deadline escalation
+ * happens inside the wait: the only wakeups are child exits and the timer.
+ * Returns the slot the child occupied, or -1 when nothing is being watched.
+ * Children without a pidfd are waited on directly before polling epoll.
+ */
+int reaper_next(Reaper *r, ReapResult *res) {
+    if (r->count == 0) {
+        return -1;
+    }
+
+    int slot = -1;
+    for (int i = 0; i < r->capacity; i++) {
+        if (r->watches[i].pid != 0 && r->watches[i].pidfd < 0) {
+            slot = i;
+            break;
+        }
+    }
+
+    while (slot < 0) {
+        reaper_arm_timer(r);
+        struct epoll_event ev;
+        int n = epoll_wait(r->epfd, &ev, 1, -1);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            DEBUG_PRINT("epoll_wait failed\n");
+            return -1;
+        }
+        if (n == 0) {
+            continue;
+        }
+        if (ev.data.u32 == TIMER_SLOT) {
+            reaper_expire(r);
+        } else {
+            slot = (int)ev.data.u32;
+        }
+    }
+
+    ReapWatch *w = &r->watches[slot];
+    pid_t child = w->pid;
+    int wstatus = 0;
+    struct rusage ru;
+    memset(&ru, 0, sizeof(ru));
+    while (wait4(child, &wstatus, 0, &ru) < 0 && errno == EINTR) {
+    }
+    DEBUG_PRINTF("Reaped child %d\n", child);
+    TRACE(TRACE_REAP, 'i', child);
+
+    if (res) {
+        res->pid = child;
+        res->status = wstatus;
+        res->timed_out = w->signalled != 0;
+        res->wall = now_seconds() - w->start;
+        res->ru = ru;
+    }
+    reaper_release(r, slot);
+    return slot;
+}
+
+/* Wait for all children at once under the active deadline. Each reaped
+ * child is recorded as a stage of g_last_job. Returns the exit code of the
+ * last child (a pipeline's status), or TIMEOUT_STATUS if any child had to
+ * be killed.
+ */
+int wait_children(pid_t *pids, int n) {
+    Reaper reaper;
+    double deadline = active_deadline();
+    double begin = now_seconds();
+    int last_code = 0;
+    int timed_out = 0;
+    ProcStats ps;
+
+    if (n <= 0) {
+        return 0;
+    }
+    stats_begin_job(n);
+    TRACE(TRACE_WAIT, 'B', n);
+    if (reaper_init(&reaper) < 0) {
+        // No epoll available: fall back to waiting one at a time.
+        for (int i = 0; i < n; i++) {
+            ReapResult res;
+            memset(&res, 0, sizeof(res));
+            res.pid = pids[i];
+            while (wait4(pids[i], &res.status, 0, &res.ru) < 0 && errno == EINTR) {
+            }
+            res.wall = now_seconds() - begin;
+            stats_from_reap(&ps, &res);
+            stats_set_stage(i, &ps);
+            limits_report(&res, &ps);
+            last_code = ps.status;
+        }
+        stats_end_job(now_seconds() - begin);
+        TRACE(TRACE_WAIT, 'E', last_code);
+        return last_code;
+    }
+
+    for (int i = 0; i < n; i++) {
+        if (reaper_add(&reaper, pids[i], deadline) < 0) {
+            print_error();
+            exit(1);
+        }
+    }
+
+    ReapResult res;
+    while (reaper_next(&reaper, &res) >= 0) {
+        if (res.timed_out) {
+            timed_out = 1;
+        }
+        stats_from_reap(&ps, &res);
+        if (!res.timed_out) {
+            limits_report(&res, &ps);
+        }
+        for (int i = 0; i < n; i++) {
+            if (pids[i] == res.pid) {
+                stats_set_stage(i, &ps);
+                break;
+            }
+        }
+        if (res.pid == pids[n - 1]) {
+            last_code = ps.status;
+        }
+    }
+    reaper_destroy(&reaper);
+    stats_end_job(now_seconds() - begin);
+    TRACE(TRACE_WAIT, 'E', last_code);
+    return timed_out ? TIMEOUT_STATUS : last_code;
+}
+
+void reaper_destroy(Reaper *r) {
+    for (int i = 0; i < r->capacity; i++) {
+        if (r->watches[i].pid != 0) {
+            reaper_release(r, i);
+        }
+    }
+    free(r->watches);
+    r->watches = NULL;
+    r->capacity = 0;
+    if (r->timerfd >= 0) {
+        close(r->timerfd);
+        r->timerfd = -1;
+    }
+    if (r->epfd >= 0) {
+        close(r->epfd);
+        r->epfd = -1;
+    }
+}
@@ -0,0 +1,211 @@
+#include "shell.h"
+#include <dlfcn.h>
+#include <stdint.h>
+
+/* Builtin registry: a name -> handler table shared by the core builtins
+ * (registered from builtins.c) and native builtins loaded at run time.
+ *
+ *   enable                       list every builtin
+ *   enable -f LIB NAME ...       load NAME from LIB (see gush_builtin.h)
+ *   enable -d NAME ...           unload builtins loaded with -f
+ *
+ * Lookups go through a perfect hash: whenever the set of names changes,
+ * rebuild() searches for a seed under which every name lands in its own
+ * slot of a power-of-two table (growing the table if no seed works). A
+ * lookup is then one hash, one slot and one strcmp, however many builtins
+ * are registered.
+ */
+
+#define MAX_SEED_TRIES 1024
+
+static BuiltinEntry *entries;
+static int entry_count;
+static int entry_cap;
+static int *slots;          // entry index + 1, 0 = empty
+static uint32_t slot_mask;
+static uint32_t seed;
+static int dirty = 1;
+static void *loading;       // Library handle "enable -f" is loading from
+
+static uint32_t name_hash(const char *name, uint32_t s) {
+    uint32_t h = 2166136261u ^ (s * 0x9e3779b9u);
+    for (const unsigned char *p = (const unsigned char *)name; *p; p++) {
+        h ^= *p;
+        h *= 16777619u;
+    }
+    return h ^ (h >> 15);
+}
+
+static void rebuild(void) {
+    uint32_t size = 16;
+    while (size < (uint32_t)entry_count * 4) size <<= 1;
+    for (;;) {
+        int *table = mem_malloc(MEM_EXEC, sizeof(int) * size);
+        for (uint32_t s = 1; s <= MAX_SEED_TRIES; s++) {
+            int ok = 1;
+            memset(table, 0, sizeof(int) * size);
+            for (int i = 0; i < entry_count && ok; i++) {
+                uint32_t idx = name_hash(entries[i].name, s) & (size - 1);
+                if (table[idx]) {
+                    ok = 0;
+                } else {
+                    table[idx] = i + 1;
+                }
+            }
+            if (ok) {
+                mem_free(MEM_EXEC, slots);
+                slots = table;
+                slot_mask = size - 1;
+                seed = s;
+                dirty = 0;
+                DEBUG_PRINTF("Builtin table: %d names, %u slots, seed %u\n",
+                             entry_count, size, s);
+                return;
+            }
+        }
+        mem_free(MEM_EXEC, table);
+        size <<= 1;
+    }
+}
+
+static BuiltinEntry *add_entry(const char *name) {
+    if (entry_count == entry_cap) {
+        int new_cap = entry_cap ? entry_cap * 2 : 32;
+        entries = mem_realloc(MEM_EXEC, entries, sizeof(BuiltinEntry) * new_cap);
+        entry_cap = new_cap;
+    }
+    BuiltinEntry *e = &entries[entry_count++];
+    memset(e, 0, sizeof(*e));
+    e->name = name;
+    dirty = 1;
+    return e;
+}
+
+void builtin_register(const char *name, BuiltinFn fn) {
+    add_entry(name)->fn = fn;
+}
+
+const BuiltinEntry *builtin_find(const char *name) {
+    if (dirty) {
+        rebuild();
+    }
+    int i = slots[name_hash(name, seed) & slot_mask];
+    if (i && strcmp(entries[i - 1].name, name) == 0) {
+        return &entries[i - 1];
+    }
+    return NULL;
+}
+
+void builtin_invoke(const BuiltinEntry *e, char **args) {
+    if (e->fn) {
+        e->fn(args);
+        return;
+    }
+    int argc = 0;
+    while (args[argc]) argc++;
+    g_last_status = e->native->run(argc, args);
+    fflush(stdout);
+}
+
+// Drop a loaded builtin, closing its library once nothing else uses it.
+static void remove_native(int index) {
+    void *handle = entries[index].handle;
+    mem_free(MEM_EXEC, (char *)entries[index].name);
+    entries[index] = entries[--entry_count];
+    dirty = 1;
+    if (handle == loading) {
+        return;  // builtin_enable balances the reference itself
+    }
+    for (int i = 0; i < entry_count; i++) {
+        if (entries[i].handle == handle) return;
+    }
+    dlclose(handle);
+}
+
+static int load_native(void *handle, const char *lib, const char *name) {
+    (void)lib;  // Only named in debug builds
+    char symbol[256];
+    snprintf(symbol, sizeof(symbol), "gush_builtin_%s", name);
+    const struct gush_builtin *def = dlsym(handle, symbol);
+    if (!def || def->abi != GUSH_BUILTIN_ABI || !def->run || !def->name ||
+        strcmp(def->name, name) != 0) {
+        DEBUG_PRINTF("enable: %s has no usable %s\n", lib, symbol);
+        return -1;
+    }
+    const BuiltinEntry *existing = builtin_find(name);
+    if (existing && existing->fn) {
+        DEBUG_PRINTF("enable: %s would shadow a core builtin\n", name);
+        return -1;
+    }
+    if (existing) {
+        // Reloading replaces the previous definition.
+        remove_native((int)(existing - entries));
+    }
+    BuiltinEntry *e = add_entry(mem_strdup(MEM_EXEC, name));
+    e->native = def;
+    e->handle = handle;
+    return 0;
+}
+
+static void list_builtins(void) {
+    for (int i = 0; i < entry_count; i++) {
+        const BuiltinEntry *e = &entries[i];
+        if (e->native) {
+            printf("%-10s %s\n", e->name, e->native->usage ? e->native->usage : "(loaded)");
+        } else {
+            printf("%s\n", e->name);
+        }
+    }
+}
+
+void builtin_enable(char **args) {
+    g_last_status = 0;
+    if (!args[1]) {
+        list_builtins();
+        return;
+    }
+    if (strcmp(args[1], "-f") == 0 && args[2] && args[3]) {
+        void *handle = dlopen(args[2], RTLD_NOW | RTLD_LOCAL);
+        if (!handle) {
+            DEBUG_PRINTF("enable: %s\n", dlerror());
+            print_error();
+            g_last_status = 1;
+            return;
+        }
+        // dlopen() returns the same handle, with one more reference, for a
+        // library that is already loaded; keep one reference per library.
+        int in_use = 0;
+        for (int i = 0; i < entry_count; i++) {
+            if (entries[i].handle == handle) in_use = 1;
+        }
+        int loaded = 0;
+        loading = handle;
+        for (int i = 3; args[i]; i++) {
+            if (load_native(handle, args[2], args[i]) == 0) {
+                loaded++;
+            } else {
+                print_error();
+                g_last_status = 1;
+            }
+        }
+        loading = NULL;
+        if (!loaded || in_use) {
+            dlclose(handle);
+        }
+        return;
+    }
+    if (strcmp(args[1], "-d") == 0 && args[2]) {
+        for (int i = 2; args[i]; i++) {
+            const BuiltinEntry *e = builtin_find(args[i]);
+            if (!e || !e->native) {
+                print_error();
+                g_last_status = 1;
+                continue;
+            }
+            remove_native((int)(e - entries));
+        }
+        return;
+    }
+    print_error();
+    g_last_status = 1;
+}
@@ -0,0 +1,227 @@
+#include "shell.h"
+#include <sys/syscall.h>
+
+/* Scheduling controls for spawned commands.
+ *
+ *   sched [-c CPUS] [-n NICE] [-p batch|idle|other] [-i CLASS[:LEVEL]] cmd ...
+ *   sched --background [options]    default for every background job
+ *   sched --background off          clear that default
+ *   sched                           show the background default
+ *
+ * CPUS is a list such as "0-3,6". NICE is an increment as for nice(1).
+ * CLASS is an I/O priority class: rt, be or idle, with LEVEL 0-7 (default
+ * 4) for rt and be. Options are collected into a SchedSpec and applied by
+ * sched_apply_child() in the forked child just before execve(), so the
+ * shell itself never changes priority. As a prefix, "sched" covers the
+ * whole rest of the line, including every stage of a pipeline; fields it
+ * leaves unset fall back to the background default for background jobs.
+ */
+
+#define IOPRIO_CLASS_SHIFT 13
+#define IOPRIO_WHO_PROCESS 1
+
+SchedSpec g_cmd_sched = {0, {{0}}, 0, 0, -1, 0, 0};
+SchedSpec g_bg_sched = {0, {{0}}, 0, 0, -1, 0, 0};
+
+static int parse_cpu_list(const char *list, cpu_set_t *set) {
+    CPU_ZERO(set);
+    const char *p = list;
+    while (*p) {
+        char *end;
+        long lo = strtol(p, &end, 10), hi = lo;
+        if (end == p) return -1;
+        if (*end == '-') {
+            p = end + 1;
+            hi = strtol(p, &end, 10);
+            if (end == p) return -1;
+        }
+        if (lo < 0 || hi < lo || hi >= CPU_SETSIZE) return -1;
+        for (long cpu = lo; cpu <= hi; cpu++) {
+            CPU_SET(cpu, set);
+        }
+        if (*end == ',') end++;
+        else if (*end) return -1;
+        p = end;
+    }
+    return CPU_COUNT(set) > 0 ? 0 : -1;
+}
+
+static int parse_ioprio(const char *arg, SchedSpec *spec) {
+    char name[8];
+    int level = 4;
+    if (sscanf(arg, "%7[a-z]:%d", name, &level) < 1 || level < 0 || level > 7) {
+        return -1;
+    }
+    if (strcmp(name, "rt") == 0) spec->ioprio_class = 1;
+    else if (strcmp(name, "be") == 0) spec->ioprio_class = 2;
+    else if (strcmp(name, "idle") == 0) spec->ioprio_class = 3;
+    else return -1;
+    spec->ioprio_level = spec->ioprio_class == 3 ? 0 : level;
+    return 0;
+}
+
+/* Parse options from args[*i] on into spec; stops at the first token that
+ * is not an option. Returns -1 on a malformed option.
+ */
+static int parse_sched_options(char **args, int count, int *i, SchedSpec *spec) {
+    while (*i < count && args[*i][0] == '-' && args[*i][1] && !args[*i][2]) {
+        if (*i + 1 >= count) return -1;
+        const char *val = args[*i + 1];
+        switch (args[*i][1]) {
+        case 'c':
+            if (parse_cpu_list(val, &spec->cpus) < 0) return -1;
+            spec->has_cpus = 1;
+            break;
+        case 'n': {
+            char *end;
+            spec->nice = strtol(val, &end, 10);
+            if (*end || end == val) return -1;
+            spec->has_nice = 1;
+            break;
+        }
+        case 'p':
+            if (strcmp(val, "batch") == 0) spec->policy = SCHED_BATCH;
+            else if (strcmp(val, "idle") == 0) spec->policy = SCHED_IDLE;
+            else if (strcmp(val, "other") == 0) spec->policy = SCHED_OTHER;
+            else return -1;
+            break;
+        case 'i':
+            if (parse_ioprio(val, spec) < 0) return -1;
+            break;
+        default:
+            return -1;
+        }
+        *i += 2;
+    }
+    return 0;
+}
+
+// Apply the current controls to this (child) process; exits on failure.
+void sched_apply_child(int background) {
+    SchedSpec spec = g_cmd_sched;
+    if (background) {
+        if (!spec.has_cpus && g_bg_sched.has_cpus) {
+            spec.has_cpus = 1;
+            spec.cpus = g_bg_sched.cpus;
+        }
+        if (!spec.has_nice && g_bg_sched.has_nice) {
+            spec.has_nice = 1;
+            spec.nice = g_bg_sched.nice;
+        }
+        if (spec.policy < 0) spec.policy = g_bg_sched.policy;
+        if (!spec.ioprio_class) {
+            spec.ioprio_class = g_bg_sched.ioprio_class;
+            spec.ioprio_level = g_bg_sched.ioprio_level;
+        }
+    }
+
+    int ok = 1;
+    if (spec.has_cpus && sched_setaffinity(0, sizeof(spec.cpus), &spec.cpus) != 0) {
+        ok = 0;
+    }
+    if (spec.policy >= 0) {
+        struct sched_param param = {0};
+        if (sched_setscheduler(0, spec.policy, &param) != 0) ok = 0;
+    }
+    if (spec.has_nice) {
+        errno = 0;
+        if (nice(spec.nice) == -1 && errno != 0) ok = 0;
+    }
+    if (spec.ioprio_class &&
+        syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0,
+                (spec.ioprio_class << IOPRIO_CLASS_SHIFT) | spec.ioprio_level) != 0) {
+        ok = 0;
+    }
+    if (!ok) {
+        DEBUG_PRINTF("sched: applying controls failed, errno: %d\n", errno);
+        print_error();
+        _exit(1);
+    }
+}
+
+/* The index-th CPU (wrapping) this shell may run on, for pinning parallel
+ * workers one per core.
+ */
+int sched_nth_cpu(int index) {
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0 || CPU_COUNT(&allowed) == 0) {
+        return index;
+    }
+    int n = index % CPU_COUNT(&allowed);
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (CPU_ISSET(cpu, &allowed) && n-- == 0) {
+            return cpu;
+        }
+    }
+    return 0;
+}
+
+static void print_spec(const SchedSpec *spec) {
+    static const char *io_names[] = {"", "rt", "be", "idle"};
+    int any = 0;
+    printf("sched --background");
+    if (spec->has_cpus) {
+        printf(" -c ");
+        const char *sep = "";
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+            if (!CPU_ISSET(cpu, &spec->cpus)) continue;
+            int end = cpu;
+            while (end + 1 < CPU_SETSIZE && CPU_ISSET(end + 1, &spec->cpus)) end++;
+            printf(end > cpu ? "%s%d-%d" : "%s%d", sep, cpu, end);
+            sep = ",";
+            cpu = end;
+        }
+        any = 1;
+    }
+    if (spec->has_nice) {
+        printf(" -n %d", spec->nice);
+        any = 1;
+    }
+    if (spec->policy >= 0) {
+        printf(" -p %s", spec->policy == SCHED_BATCH ? "batch" :
+                         spec->policy == SCHED_IDLE ? "idle" : "other");
+        any = 1;
+    }
+    if (spec->ioprio_class) {
+        printf(" -i %s:%d", io_names[spec->ioprio_class], spec->ioprio_level);
+        any = 1;
+    }
+    printf("%s\n", any ? "" : " off");
+}
+
+void run_scheduled(CommandList *cmdList) {
+    Command *first = cmdList->commands[0];
+    int i = 1;
+
+    if (first->token_count == 1) {
+        print_spec(&g_bg_sched);
+        return;
+    }
+    if (strcmp(first->tokens[1], "--background") == 0) {
+        SchedSpec spec = {0, {{0}}, 0, 0, -1, 0, 0};
+        i = 2;
+        if (first->token_count == 3 && strcmp(first->tokens[2], "off") == 0) {
+            g_bg_sched = spec;
+            return;
+        }
+        if (parse_sched_options(first->tokens, first->token_count, &i, &spec) < 0 ||
+            i != first->token_count || cmdList->count > 1) {
+            print_error();
+            return;
+        }
+        g_bg_sched = spec;
+        return;
+    }
+
+    SchedSpec saved = g_cmd_sched;
+    SchedSpec spec = g_cmd_sched;  // Nested prefixes refine the outer one
+    if (parse_sched_options(first->tokens, first->token_count, &i, &spec) < 0 ||
+        i == first->token_count) {
+        print_error();
+        return;
+    }
+    command_shift_tokens(first, i);
+    g_cmd_sched = spec;
+    run_prefixed(cmdList);
+    g_cmd_sched = saved;
+}
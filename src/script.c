@@ -0,0 +1,757 @@
+#include "shell.h"
+
+/* Control flow for scripts: for / while / if compiled to bytecode.
+ *
+ *   for NAME in word ... [; do]       words may include ranges like {1..1000}
+ *       ...
+ *   done
+ *   while cmd [; do] ... done
+ *   if cmd [; then] ... [elif cmd [; then] ...] [else ...] fi
+ *   break, continue
+ *
+ * Keywords may share a line with commands, separated by ';', as in
+ * "for x in a b; do echo $x; done". Commands after the closing keyword on
+ * the same line belong to the block. A block still open at end of input is
+ * an error: its header is dropped, and the lines it read are handed back
+ * (script_getline) to run as ordinary lines.
+ *
+ * For words split at whitespace outside quotes, so "a b" is one word, and
+ * are unquoted like command arguments. A word containing '$' is expanded
+ * each time it is bound: enclosing loop variables first, then $NAME from
+ * the environment.
+ *
+ * A block is read in full, then compiled: each body line is parsed once
+ * into a CommandList template and the control flow becomes jumps over a
+ * flat instruction array. Loop variables ($NAME or ${NAME}) are rewritten
+ * before parsing into a marker byte plus a slot number, so the VM only
+ * substitutes values into a copy of the template on each iteration instead
+ * of reparsing the text. Lines using command substitution "$(...)" are the
+ * exception and are reparsed every time, since their output can change.
+ * Conditions are ordinary commands and test their exit status, so with the
+ * in-process true/false/test builtins a loop can run without forking.
+ */
+
+#define MAX_SCRIPT_VARS 16
+#define MAX_LOOP_DEPTH 32
+#define VAR_MARK '\x01'
+
+typedef enum OpCode {
+    OP_RUN,         // Run cmds[arg] from its parsed template
+    OP_LINE,        // Reparse and run cmds[arg] (uses "$(")
+    OP_JUMP,        // Continue at target
+    OP_JUMP_FAIL,   // Continue at target if the last status is non-zero
+    OP_FOR_START,   // Reset loops[arg] to its first word
+    OP_FOR_NEXT,    // Bind the next word of loops[arg], or jump to target
+} OpCode;
+
+typedef struct Instr {
+    OpCode op;
+    int arg;
+    int target;
+} Instr;
+
+typedef struct ScriptCommand {
+    char *text;         // Source line with variables as VAR_MARK + slot
+    CommandList *list;  // Parsed template (NULL for OP_LINE)
+} ScriptCommand;
+
+/* One word of a for list: a literal, a numeric range when word is NULL,
+ * or, when expand is set, raw text with '$' that is expanded (outer loop
+ * variables, then the parser's quoting and $NAME rules) each time it is
+ * bound.
+ */
+typedef struct ForItem {
+    char *word;
+    long lo;
+    long hi;
+    int expand;
+} ForItem;
+
+typedef struct ForLoop {
+    int slot;           // Variable bound on each iteration
+    ForItem *items;
+    int count;
+    int item;           // Iteration state
+    long next;
+    char *bound;        // Expanded word currently bound (MEM_PARSER)
+} ForLoop;
+
+typedef struct Program {
+    Instr *code;
+    int len, cap;
+    ScriptCommand *cmds;
+    int ncmds, cmds_cap;
+    ForLoop *loops;
+    int nloops, loops_cap;
+    char *var_names[MAX_SCRIPT_VARS];
+    int nvars;          // Variables currently in scope (lexical)
+} Program;
+
+// Loop being compiled: where "continue" goes and the "break" jumps to patch
+typedef struct LoopContext {
+    int continue_target;
+    int breaks[64];
+    int nbreaks;
+} LoopContext;
+
+typedef struct Compiler {
+    Program *prog;
+    FILE *input;
+    int interactive;
+    LoopContext loops[MAX_LOOP_DEPTH];
+    int depth;
+    int nesting;        // Blocks open below the one read_block() started
+    int line_only;      // Stop at the end of the current input line
+    int at_eof;         // Input ended before the block did
+    char *line;         // getline() buffer
+    size_t line_cap;
+    char **queue;       // Statements of the current line not yet compiled
+    int queued, queue_next, queue_cap;
+    char **consumed;    // Input lines read, to hand back if the block is open at EOF
+    int nconsumed, consumed_cap;
+    char *current;      // Statement just read
+} Compiler;
+
+// ------------------------
+// Program construction
+// ------------------------
+
+static void *grow(void *ptr, int *cap, size_t elem) {
+    *cap = *cap ? *cap * 2 : 16;
+    return mem_realloc(MEM_PARSER, ptr, elem * *cap);
+}
+
+static int emit(Program *prog, OpCode op, int arg, int target) {
+    if (prog->len == prog->cap) {
+        prog->code = grow(prog->code, &prog->cap, sizeof(Instr));
+    }
+    prog->code[prog->len] = (Instr){op, arg, target};
+    return prog->len++;
+}
+
+// Rewrite in-scope $NAME / ${NAME} references to VAR_MARK + slot.
+static char *mark_variables(Program *prog, const char *text) {
+    size_t len = strlen(text);
+    char *out = mem_malloc(MEM_PARSER, len + 1);
+    size_t o = 0;
+    for (size_t i = 0; i < len; i++) {
+        if (text[i] == '$') {
+            int braced = text[i + 1] == '{';
+            size_t start = i + 1 + braced, end = start;
+            while (isalnum((unsigned char)text[end]) || text[end] == '_') end++;
+            for (int v = prog->nvars - 1; v >= 0 && end > start; v--) {
+                if (strlen(prog->var_names[v]) == end - start &&
+                    strncmp(prog->var_names[v], text + start, end - start) == 0 &&
+                    (!braced || text[end] == '}')) {
+                    out[o++] = VAR_MARK;
+                    out[o++] = (char)(v + 1);
+                    i = end - 1 + braced;
+                    goto next;
+                }
+            }
+        }
+        out[o++] = text[i];
+    next:;
+    }
+    out[o] = '\0';
+    return out;
+}
+
+static int add_command(Program *prog, const char *text) {
+    if (prog->ncmds == prog->cmds_cap) {
+        prog->cmds = grow(prog->cmds, &prog->cmds_cap, sizeof(ScriptCommand));
+    }
+    ScriptCommand *sc = &prog->cmds[prog->ncmds];
+    sc->text = mark_variables(prog, text);
+    sc->list = NULL;
+    if (!strstr(sc->text, "$(")) {
+        char *copy = mem_strdup(MEM_PARSER, sc->text);
+        sc->list = parse_line_advanced(copy);
+        mem_free(MEM_PARSER, copy);
+    }
+    return prog->ncmds++;
+}
+
+static void emit_command(Program *prog, const char *text) {
+    int index = add_command(prog, text);
+    emit(prog, prog->cmds[index].list ? OP_RUN : OP_LINE, index, 0);
+}
+
+// Parse "{lo..hi}" into a range item.
+static int parse_range(const char *word, ForItem *item) {
+    char tail;
+    if (sscanf(word, "{%ld..%ld%c", &item->lo, &item->hi, &tail) == 3 && tail == '}' &&
+        word[strlen(word) - 1] == '}') {
+        item->word = NULL;
+        return 1;
+    }
+    return 0;
+}
+
+static int add_loop(Program *prog, int slot, char **words, int count) {
+    if (prog->nloops == prog->loops_cap) {
+        prog->loops = grow(prog->loops, &prog->loops_cap, sizeof(ForLoop));
+    }
+    ForLoop *loop = &prog->loops[prog->nloops];
+    loop->slot = slot;
+    loop->count = count;
+    loop->bound = NULL;
+    loop->items = mem_malloc(MEM_PARSER, sizeof(ForItem) * (count ? count : 1));
+    for (int i = 0; i < count; i++) {
+        ForItem *item = &loop->items[i];
+        *item = (ForItem){NULL, 0, 0, 0};
+        if (strchr(words[i], '$')) {
+            *item = (ForItem){mark_variables(prog, words[i]), 0, 0, 1};
+        } else if (!parse_range(words[i], item)) {
+            *item = (ForItem){parse_word(words[i]), 0, 0, 0};
+        }
+    }
+    return prog->nloops++;
+}
+
+static void free_program(Program *prog) {
+    for (int i = 0; i < prog->ncmds; i++) {
+        mem_free(MEM_PARSER, prog->cmds[i].text);
+        free_command_list(prog->cmds[i].list);
+    }
+    for (int i = 0; i < prog->nloops; i++) {
+        for (int j = 0; j < prog->loops[i].count; j++) {
+            mem_free(MEM_PARSER, prog->loops[i].items[j].word);
+        }
+        mem_free(MEM_PARSER, prog->loops[i].items);
+        mem_free(MEM_PARSER, prog->loops[i].bound);
+    }
+    for (int i = 0; i < prog->nvars; i++) {
+        mem_free(MEM_PARSER, prog->var_names[i]);
+    }
+    mem_free(MEM_PARSER, prog->code);
+    mem_free(MEM_PARSER, prog->cmds);
+    mem_free(MEM_PARSER, prog->loops);
+}
+
+// ------------------------
+// Compiler
+// ------------------------
+
+enum { END_EOF, END_DONE, END_FI, END_ELSE, END_ELIF, END_ERROR };
+
+static char *trim(char *s) {
+    while (isspace((unsigned char)*s)) s++;
+    size_t len = strlen(s);
+    while (len > 0 && isspace((unsigned char)s[len - 1])) s[--len] = '\0';
+    return s;
+}
+
+// Does s start with keyword kw as a whole word?
+static int keyword(const char *s, const char *kw) {
+    size_t n = strlen(kw);
+    return strncmp(s, kw, n) == 0 && (s[n] == '\0' || isspace((unsigned char)s[n]) || s[n] == ';');
+}
+
+// Lines handed back by a block left open at end of input
+static char **pending;
+static int npending, pending_next, pending_cap;
+
+static void push_string(char ***arr, int *count, int *cap, const char *text) {
+    if (*count == *cap) {
+        *arr = grow(*arr, cap, sizeof(char *));
+    }
+    (*arr)[(*count)++] = mem_strdup(MEM_PARSER, text);
+}
+
+/* getline() for the shell's input: lines handed back by an unterminated
+ * block come first, then input.
+ */
+ssize_t script_getline(char **line, size_t *cap, FILE *input) {
+    if (pending_next == npending) {
+        return getline(line, cap, input);
+    }
+    char *text = pending[pending_next++];
+    size_t len = strlen(text);
+    if (*cap < len + 1) {
+        char *grown = realloc(*line, len + 1);  // getline()'s buffer, not tagged
+        if (!grown) {
+            print_error();
+            exit(1);
+        }
+        *line = grown;
+        *cap = len + 1;
+    }
+    memcpy(*line, text, len + 1);
+    mem_free(MEM_PARSER, text);
+    if (pending_next == npending) {
+        npending = pending_next = 0;
+    }
+    return (ssize_t)len;
+}
+
+int script_pending(void) {
+    return pending_next < npending;
+}
+
+// Put lines back in front of whatever is still pending.
+static void hand_back(char **lines, int count) {
+    char **merged = NULL;
+    int n = 0, cap = 0;
+    for (int i = 0; i < count; i++) {
+        push_string(&merged, &n, &cap, lines[i]);
+    }
+    for (int i = pending_next; i < npending; i++) {
+        push_string(&merged, &n, &cap, pending[i]);
+        mem_free(MEM_PARSER, pending[i]);
+    }
+    mem_free(MEM_PARSER, pending);
+    pending = merged;
+    npending = n;
+    pending_cap = cap;
+    pending_next = 0;
+    g_line_number -= count;
+}
+
+/* Split one input line into statements at each ';' outside quotes:
+ * "for x in a b; do echo $x; done" gives "for x in a b", "do", "echo $x"
+ * and "done", and "echo a; echo b" in a body gives two commands.
+ */
+static void split_statements(Compiler *c, char *text) {
+    char *start = trim(text);
+    while (*start) {
+        // "do cmd", "then cmd", "else cmd": the keyword stands alone
+        static const char *const openers[] = {"do", "then", "else"};
+        int split = 0;
+        for (int k = 0; k < 3 && !split; k++) {
+            size_t n = strlen(openers[k]);
+            if (keyword(start, openers[k]) && isspace((unsigned char)start[n])) {
+                start[n] = '\0';
+                push_string(&c->queue, &c->queued, &c->queue_cap, start);
+                start = trim(start + n + 1);
+                split = 1;
+            }
+        }
+        if (split) continue;
+
+        char *end = list_separator(start);
+        if (!end) end = start + strlen(start);
+        char *rest = *end ? end + 1 : end;
+        *end = '\0';
+        if (*trim(start)) {
+            push_string(&c->queue, &c->queued, &c->queue_cap, start);
+        }
+        start = trim(rest);
+    }
+}
+
+// Next statement of the block, reading a new input line when needed.
+static char *read_line(Compiler *c) {
+    mem_free(MEM_PARSER, c->current);
+    c->current = NULL;
+    while (c->queue_next == c->queued) {
+        for (int i = 0; i < c->queued; i++) mem_free(MEM_PARSER, c->queue[i]);
+        c->queued = c->queue_next = 0;
+        if (c->line_only && c->nesting == 0) {
+            return NULL;
+        }
+        if (c->interactive) {
+            printf("> ");
+            fflush(stdout);
+        }
+        ssize_t n = script_getline(&c->line, &c->line_cap, c->input);
+        if (n < 0) {
+            c->at_eof = 1;
+            return NULL;
+        }
+        g_line_number++;
+        push_string(&c->consumed, &c->nconsumed, &c->consumed_cap, c->line);
+        if (g_checkpoint) {
+            checkpoint_extend(c->line);
+        }
+        split_statements(c, c->line);
+    }
+    c->current = c->queue[c->queue_next];
+    c->queue[c->queue_next++] = NULL;
+    return c->current;
+}
+
+static int compile_block(Compiler *c);
+
+/* Split text in place into words at whitespace outside quotes, so that
+ * "a b" stays one word; the quotes themselves are left for parse_word().
+ */
+static int split_words(char *text, char **words, int max) {
+    int count = 0;
+    char *p = text;
+    for (;;) {
+        while (isspace((unsigned char)*p)) p++;
+        if (!*p || count == max) {
+            return count;
+        }
+        words[count++] = p;
+        char quote = '\0';
+        for (; *p && (quote || !isspace((unsigned char)*p)); p++) {
+            if (*p == '\\' && p[1]) {
+                p++;
+            } else if (quote && *p == quote) {
+                quote = '\0';
+            } else if (!quote && (*p == '"' || *p == '\'')) {
+                quote = *p;
+            }
+        }
+        if (*p) {
+            *p++ = '\0';
+        }
+    }
+}
+
+static int compile_for(Compiler *c, char *header) {
+    Program *prog = c->prog;
+    char *words[MAX_ARGS];
+    int count = split_words(header, words, MAX_ARGS);
+    // words: "for" NAME "in" items...
+    if (count < 3 || strcmp(words[2], "in") != 0 || prog->nvars == MAX_SCRIPT_VARS ||
+        c->depth == MAX_LOOP_DEPTH) {
+        return -1;
+    }
+    int slot = prog->nvars;
+    int loop = add_loop(prog, slot, words + 3, count - 3);
+    prog->var_names[prog->nvars++] = mem_strdup(MEM_PARSER, words[1]);
+
+    emit(prog, OP_FOR_START, loop, 0);
+    int next = emit(prog, OP_FOR_NEXT, loop, 0);
+    LoopContext *ctx = &c->loops[c->depth++];
+    ctx->continue_target = next;
+    ctx->nbreaks = 0;
+    c->nesting++;
+    int end = compile_block(c);
+    c->nesting--;
+    emit(prog, OP_JUMP, 0, next);
+    prog->code[next].target = prog->len;
+    for (int i = 0; i < ctx->nbreaks; i++) {
+        prog->code[ctx->breaks[i]].target = prog->len;
+    }
+    c->depth--;
+    mem_free(MEM_PARSER, prog->var_names[--prog->nvars]);  // NAME goes out of scope
+    return end == END_DONE ? 0 : -1;
+}
+
+static int compile_while(Compiler *c, char *cond) {
+    Program *prog = c->prog;
+    if (c->depth == MAX_LOOP_DEPTH) {
+        return -1;
+    }
+    int top = prog->len;
+    emit_command(prog, cond);
+    int exit_jump = emit(prog, OP_JUMP_FAIL, 0, 0);
+    LoopContext *ctx = &c->loops[c->depth++];
+    ctx->continue_target = top;
+    ctx->nbreaks = 0;
+    c->nesting++;
+    int end = compile_block(c);
+    c->nesting--;
+    emit(prog, OP_JUMP, 0, top);
+    prog->code[exit_jump].target = prog->len;
+    for (int i = 0; i < ctx->nbreaks; i++) {
+        prog->code[ctx->breaks[i]].target = prog->len;
+    }
+    c->depth--;
+    return end == END_DONE ? 0 : -1;
+}
+
+// "if" and "elif" share this; an elif chain ends at the single "fi".
+static int compile_if(Compiler *c, char *cond) {
+    Program *prog = c->prog;
+    emit_command(prog, cond);
+    int skip = emit(prog, OP_JUMP_FAIL, 0, 0);
+    c->nesting++;
+    int end = compile_block(c);
+    c->nesting--;
+    if (end == END_FI) {
+        prog->code[skip].target = prog->len;
+        return 0;
+    }
+    if (end != END_ELSE && end != END_ELIF) {
+        return -1;
+    }
+    int over = emit(prog, OP_JUMP, 0, 0);
+    prog->code[skip].target = prog->len;
+    int rc;
+    if (end == END_ELIF) {
+        char *elif_cond = mem_strdup(MEM_PARSER, trim(c->current + 4));
+        rc = compile_if(c, elif_cond);
+        mem_free(MEM_PARSER, elif_cond);
+    } else {
+        c->nesting++;
+        rc = compile_block(c) == END_FI ? 0 : -1;
+        c->nesting--;
+    }
+    prog->code[over].target = prog->len;
+    return rc;
+}
+
+// Compile lines until a block terminator; returns which one ended it.
+static int compile_block(Compiler *c) {
+    char *line;
+    while ((line = read_line(c)) != NULL) {
+        if (line[0] == '\0' || line[0] == '#' || strcmp(line, "do") == 0 ||
+            strcmp(line, "then") == 0) {
+            continue;
+        }
+        if (strcmp(line, "done") == 0) return END_DONE;
+        if (strcmp(line, "fi") == 0) return END_FI;
+        if (strcmp(line, "else") == 0) return END_ELSE;
+        if (keyword(line, "elif")) return END_ELIF;
+
+        char *copy = mem_strdup(MEM_PARSER, line);
+        int rc = 0;
+        if (keyword(copy, "for")) {
+            rc = compile_for(c, copy);
+        } else if (keyword(copy, "while")) {
+            rc = compile_while(c, trim(copy + 5));
+        } else if (keyword(copy, "if")) {
+            rc = compile_if(c, trim(copy + 2));
+        } else if (strcmp(copy, "break") == 0 || strcmp(copy, "continue") == 0) {
+            if (c->depth == 0) {
+                rc = -1;
+            } else {
+                LoopContext *ctx = &c->loops[c->depth - 1];
+                if (copy[0] == 'c') {
+                    emit(c->prog, OP_JUMP, 0, ctx->continue_target);
+                } else if (ctx->nbreaks < (int)(sizeof(ctx->breaks) / sizeof(ctx->breaks[0]))) {
+                    ctx->breaks[ctx->nbreaks++] = emit(c->prog, OP_JUMP, 0, 0);
+                } else {
+                    rc = -1;
+                }
+            }
+        } else {
+            emit_command(c->prog, copy);
+        }
+        mem_free(MEM_PARSER, copy);
+        if (rc < 0) {
+            return END_ERROR;
+        }
+    }
+    return END_EOF;
+}
+
+// ------------------------
+// Virtual machine
+// ------------------------
+
+// Copy s with each VAR_MARK + slot replaced by the variable's value.
+static char *expand_vars(const char *s, char **values) {
+    if (!strchr(s, VAR_MARK)) {
+        return mem_strdup(MEM_PARSER, s);
+    }
+    size_t cap = strlen(s) + 64, o = 0;
+    char *out = mem_malloc(MEM_PARSER, cap);
+    for (; *s; s++) {
+        const char *value = NULL;
+        size_t vlen = 1;
+        if (*s == VAR_MARK && s[1]) {
+            value = values[(unsigned char)s[1] - 1];
+            if (!value) value = "";
+            vlen = strlen(value);
+            s++;
+        }
+        if (o + vlen + 1 > cap) {
+            cap = (o + vlen + 1) * 2;
+            out = mem_realloc(MEM_PARSER, out, cap);
+        }
+        if (value) {
+            memcpy(out + o, value, vlen);
+            o += vlen;
+        } else {
+            out[o++] = *s;
+        }
+    }
+    out[o] = '\0';
+    return out;
+}
+
+// expand_vars() that passes NULL through; exits if memory runs out.
+static char *expand_or_die(const char *s, char **values) {
+    return s ? expand_vars(s, values) : NULL;
+}
+
+// Instantiate a parsed template for this iteration.
+static CommandList *instantiate(const CommandList *tmpl, char **values) {
+    CommandList *list = mem_malloc(MEM_PARSER, sizeof(CommandList));
+    list->count = tmpl->count;
+    list->commands = mem_malloc(MEM_PARSER, sizeof(Command*) * (tmpl->count ? tmpl->count : 1));
+    for (int i = 0; i < tmpl->count; i++) {
+        const Command *src = tmpl->commands[i];
+        Command *cmd = mem_malloc(MEM_PARSER, sizeof(Command));
+        cmd->tokens = mem_malloc(MEM_PARSER, sizeof(char*) * MAX_ARGS);
+        cmd->token_count = src->token_count;
+        cmd->background = src->background;
+        for (int t = 0; t < src->token_count; t++) {
+            cmd->tokens[t] = expand_or_die(src->tokens[t], values);
+        }
+        cmd->tokens[src->token_count] = NULL;
+        cmd->input_file = expand_or_die(src->input_file, values);
+        cmd->output_file = expand_or_die(src->output_file, values);
+        cmd->redir_count = src->redir_count;
+        cmd->redirs = NULL;
+        if (src->redir_count > 0) {
+            cmd->redirs = mem_malloc(MEM_PARSER, sizeof(Redirect) * src->redir_count);
+            for (int r = 0; r < src->redir_count; r++) {
+                cmd->redirs[r] = src->redirs[r];
+                cmd->redirs[r].path = expand_or_die(src->redirs[r].path, values);
+            }
+        }
+        list->commands[i] = cmd;
+    }
+    return list;
+}
+
+// Bind the loop's next word; 0 when the loop is exhausted.
+static int for_next(ForLoop *loop, char **values, char *numbuf, size_t numsize) {
+    while (loop->item < loop->count) {
+        ForItem *it = &loop->items[loop->item];
+        if (it->expand) {
+            char *marked = expand_vars(it->word, values);
+            mem_free(MEM_PARSER, loop->bound);
+            loop->bound = parse_word(marked);
+            mem_free(MEM_PARSER, marked);
+            values[loop->slot] = loop->bound;
+            loop->item++;
+            if (loop->item < loop->count) loop->next = loop->items[loop->item].lo;
+            return 1;
+        }
+        if (it->word) {
+            values[loop->slot] = it->word;
+            loop->item++;
+            if (loop->item < loop->count) loop->next = loop->items[loop->item].lo;
+            return 1;
+        }
+        long step = it->lo <= it->hi ? 1 : -1;
+        if (loop->next == it->hi + step) {
+            loop->item++;
+            if (loop->item < loop->count) loop->next = loop->items[loop->item].lo;
+            continue;
+        }
+        snprintf(numbuf, numsize, "%ld", loop->next);
+        values[loop->slot] = numbuf;
+        loop->next += step;
+        return 1;
+    }
+    return 0;
+}
+
+static void run_program(Program *prog) {
+    char *values[MAX_SCRIPT_VARS] = {0};
+    char numbufs[MAX_SCRIPT_VARS][24];
+    int pc = 0;
+
+    while (pc < prog->len) {
+        Instr *in = &prog->code[pc];
+        switch (in->op) {
+        case OP_RUN: {
+            ScriptCommand *sc = &prog->cmds[in->arg];
+            CommandList *list = instantiate(sc->list, values);
+            char *text = g_log_json ? expand_or_die(sc->text, values) : NULL;
+            run_command_list(text ? text : sc->text, list);
+            mem_free(MEM_PARSER, text);
+            free_command_list(list);
+            pc++;
+            break;
+        }
+        case OP_LINE: {
+            char *text = expand_or_die(prog->cmds[in->arg].text, values);
+            process_line(text);
+            mem_free(MEM_PARSER, text);
+            pc++;
+            break;
+        }
+        case OP_JUMP:
+            pc = in->target;
+            break;
+        case OP_JUMP_FAIL:
+            pc = g_last_status != 0 ? in->target : pc + 1;
+            break;
+        case OP_FOR_START: {
+            ForLoop *loop = &prog->loops[in->arg];
+            loop->item = 0;
+            loop->next = loop->count > 0 ? loop->items[0].lo : 0;
+            pc++;
+            break;
+        }
+        case OP_FOR_NEXT: {
+            ForLoop *loop = &prog->loops[in->arg];
+            if (for_next(loop, values, numbufs[loop->slot], sizeof(numbufs[0]))) {
+                pc++;
+            } else {
+                pc = in->target;
+            }
+            break;
+        }
+        }
+    }
+}
+
+int script_starts_block(const char *line) {
+    while (isspace((unsigned char)*line)) line++;
+    return keyword(line, "for") || keyword(line, "while") || keyword(line, "if");
+}
+
+/* Read the rest of the block begun by first_line from input, compile it
+ * and run it, unless a --resume run finds that an earlier run completed
+ * the same block. A syntax error (unbalanced block, bad for header, break
+ * outside a loop) reports an error and runs nothing. If input ended with
+ * the block still open, the lines it read are handed back so the rest of
+ * the script still runs.
+ */
+void script_run_block(const char *first_line, FILE *input, int interactive) {
+    Program prog;
+    Compiler c;
+    memset(&prog, 0, sizeof(prog));
+    memset(&c, 0, sizeof(c));
+    c.prog = &prog;
+    c.input = input;
+    c.interactive = interactive;
+
+    // The header line may hold the whole block ("for ...; do ...; done")
+    char *header = mem_strdup(MEM_PARSER, first_line);
+    split_statements(&c, header);
+    mem_free(MEM_PARSER, header);
+    char *h = read_line(&c);
+    int rc;
+    if (keyword(h, "for")) {
+        rc = compile_for(&c, h);
+    } else if (keyword(h, "while")) {
+        rc = compile_while(&c, trim(h + 5));
+    } else {
+        rc = compile_if(&c, trim(h + 2));
+    }
+    if (rc == 0) {
+        // Commands after the closing keyword, on the same line
+        c.line_only = 1;
+        rc = compile_block(&c) == END_EOF ? 0 : -1;
+    }
+
+    DEBUG_PRINTF("Compiled block: %d instructions, %d commands\n", prog.len, prog.ncmds);
+    int status;
+    int done = g_checkpoint && checkpoint_completed(&status);
+    for (int i = 0; done && i < prog.ncmds; i++) {
+        // A block that changes shell state runs again (see checkpoint.c)
+        if (checkpoint_changes_state(prog.cmds[i].text)) {
+            done = 0;
+        }
+    }
+    if (rc < 0) {
+        print_error();
+        if (c.at_eof) {
+            hand_back(c.consumed, c.nconsumed);
+        }
+    } else if (!done) {
+        run_program(&prog);
+    }
+    if (done) {
+        g_last_status = status;
+    }
+    free_program(&prog);
+    for (int i = 0; i < c.queued; i++) mem_free(MEM_PARSER, c.queue[i]);
+    for (int i = 0; i < c.nconsumed; i++) mem_free(MEM_PARSER, c.consumed[i]);
+    mem_free(MEM_PARSER, c.queue);
+    mem_free(MEM_PARSER, c.consumed);
+    mem_free(MEM_PARSER, c.current);
+    free(c.line);  // getline()'s buffer
+}
@@ -0,0 +1,506 @@
+#include "shell.h"
+#include <poll.h>
+#include <signal.h>
+#include <stdint.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+/* Command server mode.
+ *
+ *   gush --serve /path/to.sock          long-lived daemon
+ *   gush --client /path/to.sock [cmd]   send cmd (or each stdin line)
+ *
+ * The daemon pays for startup and a warm executable cache once. Every
+ * connection is handled in a forked child, so a request's cwd and
+ * environment changes never leak into the daemon or other requests, and
+ * requests run concurrently. Requests and replies are framed as a one-byte
+ * type, a 32-bit length and a payload:
+ *
+ *   client -> server   'F' stdio fds, 'D' cwd, 'V' NAME=value (repeated),
+ *                      'C' command line
+ *   server -> client   'O' stdout bytes, 'E' stderr bytes, 'X' exit status
+ *
+ * The 'F' frame carries the client's stdin, stdout and stderr as
+ * SCM_RIGHTS ancillary data. The worker dup2()s them onto 0/1/2 before
+ * running the line, so children spawned by execute_external() and
+ * execute_pipeline() read and write the caller's terminal or files
+ * directly and no output passes through the daemon. Without an 'F' frame
+ * the daemon falls back to relaying output as 'O'/'E' frames.
+ *
+ * A connection runs commands as the daemon's user, so the socket is
+ * created with mode 0600 and a peer whose SO_PEERCRED uid differs from
+ * ours is dropped before any frame is read.
+ */
+
+#define FRAME_MAX (1 << 20)
+#define SERVER_BACKLOG 64
+#define STDIO_FDS 3
+
+static int write_all(int fd, const void *buf, size_t len) {
+    const char *p = buf;
+    while (len > 0) {
+        ssize_t n = write(fd, p, len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+static int read_all(int fd, void *buf, size_t len) {
+    char *p = buf;
+    while (len > 0) {
+        ssize_t n = read(fd, p, len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        if (n == 0) {
+            return -1;  // Peer closed mid-frame
+        }
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+static int write_frame(int fd, char type, const void *data, uint32_t len) {
+    char header[5];
+    header[0] = type;
+    memcpy(header + 1, &len, sizeof(len));
+    if (write_all(fd, header, sizeof(header)) < 0) {
+        return -1;
+    }
+    return len ? write_all(fd, data, len) : 0;
+}
+
+/* Read a frame header with recvmsg() so descriptors attached to it are
+ * picked up. Received fds are stored in fds[] (up to STDIO_FDS) and
+ * counted in *nfds; extras are closed.
+ */
+static int read_header(int fd, char header[5], int *fds, int *nfds) {
+    union {
+        char buf[CMSG_SPACE(sizeof(int) * STDIO_FDS)];
+        struct cmsghdr align;
+    } control;
+    struct iovec iov = {header, 5};
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+
+    ssize_t n;
+    while ((n = recvmsg(fd, &msg, MSG_CMSG_CLOEXEC)) < 0 && errno == EINTR) {
+    }
+    if (n <= 0) {
+        return -1;
+    }
+    for (struct cmsghdr *c = CMSG_FIRSTHDR(&msg); c; c = CMSG_NXTHDR(&msg, c)) {
+        if (c->cmsg_level != SOL_SOCKET || c->cmsg_type != SCM_RIGHTS) continue;
+        int count = (c->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        int *received = (int *)CMSG_DATA(c);
+        for (int i = 0; i < count; i++) {
+            if (fds && *nfds < STDIO_FDS) {
+                fds[(*nfds)++] = received[i];
+            } else {
+                close(received[i]);
+            }
+        }
+    }
+    return n < 5 ? read_all(fd, header + n, 5 - n) : 0;
+}
+
+// Read one frame; the payload is NUL-terminated for convenience.
+static int read_frame_fds(int fd, char *type, char **data, uint32_t *len,
+                          int *fds, int *nfds) {
+    char header[5];
+    if (read_header(fd, header, fds, nfds) < 0) {
+        return -1;
+    }
+    *type = header[0];
+    memcpy(len, header + 1, sizeof(*len));
+    if (*len > FRAME_MAX) {
+        return -1;
+    }
+    *data = malloc(*len + 1);
+    if (!*data) {
+        return -1;
+    }
+    if (*len && read_all(fd, *data, *len) < 0) {
+        free(*data);
+        return -1;
+    }
+    (*data)[*len] = '\0';
+    return 0;
+}
+
+static int read_frame(int fd, char *type, char **data, uint32_t *len) {
+    int nfds = 0;
+    return read_frame_fds(fd, type, data, len, NULL, &nfds);
+}
+
+// Send an empty 'F' frame with fds attached as SCM_RIGHTS.
+static int send_fds(int sock, const int *fds, int nfds) {
+    char header[5] = {'F', 0, 0, 0, 0};
+    union {
+        char buf[CMSG_SPACE(sizeof(int) * STDIO_FDS)];
+        struct cmsghdr align;
+    } control;
+    struct iovec iov = {header, sizeof(header)};
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    memset(&control, 0, sizeof(control));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = CMSG_SPACE(sizeof(int) * nfds);
+
+    struct cmsghdr *c = CMSG_FIRSTHDR(&msg);
+    c->cmsg_level = SOL_SOCKET;
+    c->cmsg_type = SCM_RIGHTS;
+    c->cmsg_len = CMSG_LEN(sizeof(int) * nfds);
+    memcpy(CMSG_DATA(c), fds, sizeof(int) * nfds);
+
+    ssize_t n;
+    while ((n = sendmsg(sock, &msg, MSG_NOSIGNAL)) < 0 && errno == EINTR) {
+    }
+    if (n < 0) {
+        return -1;
+    }
+    return n < (ssize_t)sizeof(header) ? write_all(sock, header + n, sizeof(header) - n) : 0;
+}
+
+// Forward a pipe to the client as frames of the given type; 0 at EOF.
+static int relay_pipe(int pipe_fd, int conn, char type) {
+    char buf[16384];
+    ssize_t n = read(pipe_fd, buf, sizeof(buf));
+    if (n < 0) {
+        return errno == EINTR ? 1 : 0;
+    }
+    if (n == 0) {
+        return 0;
+    }
+    if (write_frame(conn, type, buf, (uint32_t)n) < 0) {
+        _exit(1);  // Client went away
+    }
+    return 1;
+}
+
+static int wait_worker(pid_t worker) {
+    int status = 0;
+    while (waitpid(worker, &status, 0) < 0 && errno == EINTR) {
+    }
+    return exit_status_code(status);
+}
+
+// Run one command line directly on the client's own stdio descriptors.
+static int run_on_fds(int conn, char *line, const int *fds) {
+    fflush(stdout);
+    fflush(stderr);
+    pid_t worker = fork();
+    if (worker < 0) {
+        return 1;
+    }
+    if (worker == 0) {
+        for (int i = 0; i < STDIO_FDS; i++) {
+            if (fds[i] != i) {
+                dup2(fds[i], i);  // dup2 clears FD_CLOEXEC on the new fd
+                close(fds[i]);
+            } else {
+                fcntl(i, F_SETFD, 0);
+            }
+        }
+        close(conn);
+        process_line(line);
+        fflush(stdout);
+        fflush(stderr);
+        _exit(g_last_status & 0xff);
+    }
+    return wait_worker(worker);
+}
+
+// Run one command line with stdout/stderr relayed back over conn.
+static int run_relayed(int conn, char *line) {
+    int out_pipe[2], err_pipe[2];
+    if (pipe2(out_pipe, O_CLOEXEC) < 0 || pipe2(err_pipe, O_CLOEXEC) < 0) {
+        return 1;
+    }
+    fflush(stdout);
+    fflush(stderr);
+
+    pid_t worker = fork();
+    if (worker < 0) {
+        return 1;
+    }
+    if (worker == 0) {
+        int devnull = open("/dev/null", O_RDONLY | O_CLOEXEC);
+        if (devnull >= 0) {
+            dup2(devnull, STDIN_FILENO);
+            close(devnull);
+        }
+        dup2(out_pipe[1], STDOUT_FILENO);
+        dup2(err_pipe[1], STDERR_FILENO);
+        close(conn);
+        process_line(line);
+        fflush(stdout);
+        fflush(stderr);
+        _exit(g_last_status & 0xff);
+    }
+
+    close(out_pipe[1]);
+    close(err_pipe[1]);
+    struct pollfd fds[2] = {
+        {out_pipe[0], POLLIN, 0},
+        {err_pipe[0], POLLIN, 0},
+    };
+    int open_count = 2;
+    while (open_count > 0) {
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        for (int i = 0; i < 2; i++) {
+            if (fds[i].fd >= 0 && (fds[i].revents & (POLLIN | POLLHUP))) {
+                if (!relay_pipe(fds[i].fd, conn, i == 0 ? 'O' : 'E')) {
+                    close(fds[i].fd);
+                    fds[i].fd = -1;
+                    open_count--;
+                }
+            }
+        }
+    }
+
+    return wait_worker(worker);
+}
+
+// Per-connection handler (runs in its own forked process).
+static void handle_connection(int conn) {
+    char type;
+    char *data;
+    uint32_t len;
+    int env_cleared = 0;
+    int fds[STDIO_FDS];
+    int nfds = 0;
+
+    signal(SIGCHLD, SIG_DFL);
+    while (read_frame_fds(conn, &type, &data, &len, fds, &nfds) == 0) {
+        if (type == 'F') {
+            free(data);  // The descriptors were collected with the header
+        } else if (type == 'D') {
+            if (cwd_change(data) != 0) {
+                const char *msg = ERROR_MSG;
+                write_frame(conn, 'E', msg, strlen(msg));
+            }
+            free(data);
+        } else if (type == 'V') {
+            if (!env_cleared) {
+                clearenv();
+                env_cleared = 1;
+            }
+            putenv(data);  // putenv keeps the string; the process is short-lived
+        } else if (type == 'C') {
+            int32_t code = nfds == STDIO_FDS ? run_on_fds(conn, data, fds)
+                                             : run_relayed(conn, data);
+            free(data);
+            write_frame(conn, 'X', &code, sizeof(code));
+            break;
+        } else {
+            free(data);
+            break;
+        }
+    }
+    for (int i = 0; i < nfds; i++) {
+        close(fds[i]);
+    }
+    close(conn);
+}
+
+// True if the process at the other end of conn runs as our user.
+static int peer_is_owner(int conn) {
+    struct ucred cred;
+    socklen_t len = sizeof(cred);
+    if (getsockopt(conn, SOL_SOCKET, SO_PEERCRED, &cred, &len) < 0) {
+        return 0;
+    }
+    return cred.uid == geteuid();
+}
+
+int serve_main(const char *sock_path) {
+    struct sockaddr_un addr;
+    if (strlen(sock_path) >= sizeof(addr.sun_path)) {
+        print_error();
+        return 1;
+    }
+    int listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listen_fd < 0) {
+        print_error();
+        return 1;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, sock_path);
+    unlink(sock_path);
+    // The socket file gets mode 0600 from the start, with no window
+    // between bind() and a later chmod()
+    mode_t old_mask = umask(0177);
+    int bound = bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr));
+    umask(old_mask);
+    if (bound < 0 || listen(listen_fd, SERVER_BACKLOG) < 0) {
+        print_error();
+        close(listen_fd);
+        return 1;
+    }
+
+    lookup_cache_prewarm();
+    signal(SIGPIPE, SIG_IGN);
+    signal(SIGCHLD, SIG_IGN);  // Handlers are reaped automatically
+    DEBUG_PRINTF("Serving on %s\n", sock_path);
+
+    while (1) {
+        int conn = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC);
+        if (conn < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            print_error();
+            break;
+        }
+        if (!peer_is_owner(conn)) {
+            close(conn);
+            continue;
+        }
+        fflush(stdout);
+        pid_t pid = fork();
+        if (pid == 0) {
+            close(listen_fd);
+            handle_connection(conn);
+            _exit(0);
+        }
+        if (pid < 0) {
+            print_error();
+        }
+        close(conn);
+    }
+    close(listen_fd);
+    return 1;
+}
+
+// ------------------------
+// Client side
+// ------------------------
+
+extern char **environ;
+
+static int client_connect(const char *sock_path) {
+    struct sockaddr_un addr;
+    if (strlen(sock_path) >= sizeof(addr.sun_path)) {
+        return -1;
+    }
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, sock_path);
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/* Send one request, passing our stdio so the command writes to it
+ * directly. stdin_fd replaces fd 0 when stdin is already in use for
+ * reading request lines. Any relayed 'O'/'E' frames are still honoured.
+ */
+static int client_request(const char *sock_path, const char *line, int stdin_fd) {
+    int fd = client_connect(sock_path);
+    if (fd < 0) {
+        print_error();
+        return 1;
+    }
+    int stdio[STDIO_FDS] = {stdin_fd, STDOUT_FILENO, STDERR_FILENO};
+    if (send_fds(fd, stdio, STDIO_FDS) < 0) {
+        print_error();
+        close(fd);
+        return 1;
+    }
+    const char *cwd = cwd_path();
+    write_frame(fd, 'D', cwd, strlen(cwd));
+    for (char **env = environ; env && *env; env++) {
+        write_frame(fd, 'V', *env, strlen(*env));
+    }
+    write_frame(fd, 'C', line, strlen(line));
+
+    int code = 1;
+    char type;
+    char *data;
+    uint32_t len;
+    while (read_frame(fd, &type, &data, &len) == 0) {
+        if (type == 'O') {
+            write_all(STDOUT_FILENO, data, len);
+        } else if (type == 'E') {
+            write_all(STDERR_FILENO, data, len);
+        } else if (type == 'X' && len == sizeof(int32_t)) {
+            int32_t status;
+            memcpy(&status, data, sizeof(status));
+            code = status;
+        }
+        free(data);
+    }
+    close(fd);
+    return code;
+}
+
+/* Thin client: the command comes from the arguments, or else each line of
+ * stdin is sent as its own request. Exits with the last request's status.
+ */
+int client_main(const char *sock_path, char **cmd_args) {
+    if (cmd_args && cmd_args[0]) {
+        size_t len = 1;
+        for (int i = 0; cmd_args[i]; i++) {
+            len += strlen(cmd_args[i]) + 1;
+        }
+        char *line = malloc(len);
+        if (!line) {
+            print_error();
+            return 1;
+        }
+        line[0] = '\0';
+        for (int i = 0; cmd_args[i]; i++) {
+            if (i > 0) strcat(line, " ");
+            strcat(line, cmd_args[i]);
+        }
+        int code = client_request(sock_path, line, STDIN_FILENO);
+        free(line);
+        return code;
+    }
+
+    // stdin carries the requests, so the commands get /dev/null instead
+    int devnull = open("/dev/null", O_RDONLY | O_CLOEXEC);
+    if (devnull < 0) {
+        print_error();
+        return 1;
+    }
+    char *line = NULL;
+    size_t cap = 0;
+    ssize_t n;
+    int code = 0;
+    while ((n = getline(&line, &cap, stdin)) != -1) {
+        if (n > 0 && line[n - 1] == '\n') {
+            line[n - 1] = '\0';
+        }
+        if (line[0] == '\0' || line[0] == '#') {
+            continue;
+        }
+        code = client_request(sock_path, line, devnull);
+    }
+    free(line);
+    close(devnull);
+    return code;
+}
@@ -1,14 +1,42 @@
 #ifndef SHELL_H
 #define SHELL_H
 
+// Expose POSIX/Linux APIs (getline, strdup, pidfd, epoll) under -std=c99
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
 #include <sys/wait.h>
+#include <sys/resource.h>
+#include <sys/time.h>
 #include <fcntl.h>
 #include <errno.h>
 #include <ctype.h>
+#include <time.h>
+#include <sched.h>
+#include "gush_builtin.h"
+
+// Runtime trace points (see trace.c); one flag test when tracing is off
+enum TraceType {
+    TRACE_LINE = 1,
+    TRACE_PARSE,
+    TRACE_LOOKUP,
+    TRACE_FORK,
+    TRACE_EXEC,
+    TRACE_PIPE,
+    TRACE_WAIT,
+    TRACE_REAP,
+    TRACE_BUILTIN
+};
+extern int g_trace_enabled;
+void trace_record(int type, char phase, long arg);
+#define TRACE(type, phase, arg) do { \
+        if (g_trace_enabled) trace_record((type), (phase), (long)(arg)); \
+    } while (0)
 
 // Debug macros
 #ifdef DEBUG
@@ -33,14 +61,39 @@
 // Size of the circular command history
 #define HISTORY_SIZE 10
 
+// Seconds between SIGTERM and SIGKILL when a deadline expires
+#define TIMEOUT_KILL_GRACE 2.0
+
+// Exit status reported for commands killed by a deadline (as coreutils timeout)
+#define TIMEOUT_STATUS 124
+
 // Global variables for the shell search path (defined in main.c).
 extern char **g_path;
 extern int g_path_count;
 
+// Exit status of the last command (defined in utils.c; print_error() sets 1).
+extern int g_last_status;
+
+// Absolute CLOCK_MONOTONIC deadlines (0 = none), defined in reap.c.
+// g_line_deadline bounds the current batch line (--line-timeout);
+// g_cmd_deadline bounds the command under a "timeout" prefix.
+extern double g_line_deadline;
+extern double g_cmd_deadline;
+
 // ------------------------
 // Advanced Parser Data Structures
 // ------------------------
 
+// One output redirection: "N>path", "N>>path" or "N>&M", applied in order
+typedef struct Redirect {
+    int fd;             // Descriptor being redirected
+    int dup_from;       // Source descriptor for N>&M, or -1 to open path
+    char *path;         // Target file (NULL for N>&M)
+    int append;         // 1 for >> (O_APPEND), 0 for > (O_TRUNC)
+    long long prealloc; // Bytes to fallocate up front (">:prealloc=SIZE")
+    int nocache;        // Write back and drop from the page cache when done
+} Redirect;
+
 // Represents a single command (one pipeline segment)
 typedef struct Command {
     char **tokens;      // Array of token strings
@@ -48,6 +101,8 @@ typedef struct Command {
     int background;     // 1 if command should run in background
     char *input_file;   // Filename for input redirection, if any
     char *output_file;  // Filename for output redirection, if any
+    Redirect *redirs;   // Output redirections in command-line order
+    int redir_count;    // Number of entries in redirs
 } Command;
 
 // Represents a list of commands (separated by semicolons or pipelines)
@@ -63,11 +118,15 @@ typedef struct CommandList {
 // Utils
 void print_error();
 void debug_print(const char *msg);
+double now_seconds(void);
+double percentile(const double *sorted, int n, double p);
+int compare_doubles(const void *a, const void *b);
 
 // History management
 void add_history(const char *line);
 void print_history();
 char *get_history_command(int num);
+int history_length(void);
 void free_history_entries();
 
 // Simple parsing
@@ -77,16 +136,243 @@ char **parse_line(char *line, int *background, char **input_file, char **output_
 int is_builtin(char **args);
 void execute_builtin(char **args);
 
+// Builtin registry (perfect-hashed name table, "enable -f"), see registry.c
+typedef void (*BuiltinFn)(char **args);
+
+typedef struct BuiltinEntry {
+    const char *name;
+    BuiltinFn fn;                       // Core builtin, or NULL
+    const struct gush_builtin *native;  // Builtin loaded with "enable -f"
+    void *handle;                       // dlopen() handle of its library
+} BuiltinEntry;
+
+void builtin_register(const char *name, BuiltinFn fn);
+const BuiltinEntry *builtin_find(const char *name);
+void builtin_invoke(const BuiltinEntry *e, char **args);
+void builtin_enable(char **args);
+
 // External command execution (including redirection and pipes)
 char *search_executable(char *command);
-void execute_external(char **args, int background, char *input_file, char *output_file);
-void execute_pipeline(Command **commands, int num_cmds, int background);
+void lookup_cache_invalidate(void);
+void lookup_cache_prewarm(void);
+pid_t spawn_external(char **args, int in_fd, int out_fd, int err_fd, int background);
+void close_inherited_fds(void);
+void close_fds_except(const int *keep, int count);
+int exit_status_code(int status);
+int execute_external(char **args, int background, char *input_file, char *output_file,
+                     const Redirect *redirs, int redir_count);
+int execute_pipeline(Command **commands, int num_cmds, int background);
+
+// In-shell wc/head/grep run by forked pipeline stages, see filters.c
+extern int g_filters_enabled;
+int filter_supported(char **args, const char *exec_path);
+int filter_run(char **args);
+
+// Interactive line editor and command completion, see lineedit.c and complete.c
+int lineedit_enabled(void);
+ssize_t lineedit_read(const char *prompt, char **line, size_t *cap);
+void complete_refresh(void);
+int complete_command(const char *prefix, char *common, size_t size, char **names, int max);
+
+// Cached working directory and pushd/popd/dirs, see cwd.c
+const char *cwd_path(void);
+int cwd_dirfd(void);
+int cwd_openat(const char *path, int flags, mode_t mode);
+void cwd_reserve_child(const Redirect *redirs, int count);
+int cwd_change(const char *path);
+void builtin_cd(char **args);
+void builtin_pwd(char **args);
+void builtin_pushd(char **args);
+void builtin_popd(char **args);
+void builtin_dirs(char **args);
+
+// Background jobs and coprocesses, see jobs.c
+int jobs_add(pid_t *pids, int n, char **args);
+void jobs_reap(void);
+pid_t jobs_pid(const char *spec);
+int coproc_fd(const char *name, int writing);
+void builtin_jobs(char **args);
+void builtin_coproc(char **args);
+
+// Child reaping event loop (pidfd + epoll + timerfd), see reap.c
+typedef struct ReapWatch {
+    pid_t pid;          // Child being watched (0 = free slot)
+    int pidfd;          // pidfd for the child, or -1 if unavailable
+    double start;       // When the watch began (close to spawn time)
+    double deadline;    // Next escalation time (0 = none)
+    int signalled;      // 0 = untouched, 1 = SIGTERM sent, 2 = SIGKILL sent
+} ReapWatch;
+
+typedef struct Reaper {
+    int epfd;           // epoll instance watching every pidfd and the timer
+    int timerfd;        // Armed for the earliest pending deadline
+    ReapWatch *watches; // Slot array indexed by epoll data
+    int capacity;       // Allocated slots
+    int count;          // Children currently being watched
+} Reaper;
+
+// Outcome of reaping one child
+typedef struct ReapResult {
+    pid_t pid;
+    int status;         // Raw wait4() status
+    int timed_out;      // 1 if the child was signalled for missing its deadline
+    double wall;        // Seconds between reaper_add() and the reap
+    struct rusage ru;   // Resource usage reported by wait4()
+} ReapResult;
+
+int pidfd_open_pid(pid_t pid);
+double active_deadline(void);
+int reaper_init(Reaper *r);
+int reaper_add(Reaper *r, pid_t pid, double deadline);
+int reaper_next(Reaper *r, ReapResult *res);
+void reaper_destroy(Reaper *r);
+int wait_children(pid_t *pids, int n);
+
+// Per-process resource accounting, see stats.c
+typedef struct ProcStats {
+    pid_t pid;
+    int status;         // Shell-style exit code
+    double wall;        // Seconds from spawn to reap
+    double user;        // User CPU seconds
+    double sys;         // System CPU seconds
+    long maxrss_kb;     // Peak resident set size
+    long nvcsw;         // Voluntary context switches
+    long nivcsw;        // Involuntary context switches
+    long inblock;       // Block input operations
+    long oublock;       // Block output operations
+} ProcStats;
+
+// Maximum pipeline stages kept per job record
+#define MAX_JOB_STAGES 64
+
+// Resource usage of the most recent foreground job (one entry per stage)
+typedef struct JobStats {
+    int count;          // Stages recorded
+    double wall;        // Wall time of the whole job
+    ProcStats stages[MAX_JOB_STAGES];
+} JobStats;
+
+extern JobStats g_last_job;
+
+void stats_from_reap(ProcStats *ps, const ReapResult *res);
+void stats_begin_job(int stages);
+void stats_set_stage(int index, const ProcStats *ps);
+void stats_add_session(const ProcStats *ps);
+void stats_end_job(double wall);
+void stats_count_command(void);
+void print_job_stats(const JobStats *job, double wall, const struct rusage *self_delta);
+void builtin_stats(char **args);
+
+// JSON-lines execution log (--log-json), see log.c
+extern int g_log_json;      // Non-zero when logging is enabled
+extern int g_line_number;   // Current batch/input line, for log records
+int log_json_open(const char *path);
+void log_begin_command(const char *line);
+void log_stage_spawned(int index, char **argv, const char *path, pid_t pid, double spawn);
+void log_end_command(int builtin, int background);
+
+// Trace control, see trace.c
+int trace_enable_at_exit(const char *path);
+void builtin_trace(char **args);
+
+// Repeated-run benchmarking builtin, see benchmark.c
+void builtin_bench(char **args);
+
+// Command server over a Unix socket (--serve / --client), see server.c
+int serve_main(const char *sock_path);
+int client_main(const char *sock_path, char **cmd_args);
+
+// Parallel fan-out builtin, see parallel.c
+void builtin_parallel(char **args);
+
+// Scheduling controls applied in spawned children, see sched.c
+typedef struct SchedSpec {
+    int has_cpus;
+    cpu_set_t cpus;     // sched_setaffinity() mask
+    int has_nice;
+    int nice;           // Increment, as nice(1)
+    int policy;         // SCHED_BATCH / SCHED_IDLE / SCHED_OTHER, -1 = unchanged
+    int ioprio_class;   // 1 rt, 2 be, 3 idle, 0 = unchanged
+    int ioprio_level;
+} SchedSpec;
+extern SchedSpec g_cmd_sched;   // Set by the "sched" prefix for the current line
+extern SchedSpec g_bg_sched;    // Defaults for background jobs
+void sched_apply_child(int background);
+int sched_nth_cpu(int index);
+void run_scheduled(CommandList *cmdList);
+
+// Resource limits applied in spawned children ("ulimit"), see limits.c
+#define MAX_LIMITS 9
+typedef struct LimitSpec {
+    int set[MAX_LIMITS];
+    rlim_t value[MAX_LIMITS];   // In bytes/seconds/counts, or RLIM_INFINITY
+} LimitSpec;
+extern LimitSpec g_cmd_limits;  // Set by the "ulimit" prefix for the current line
+void limits_apply_child(void);
+void limits_report(const ReapResult *res, const ProcStats *ps);
+void run_limited(CommandList *cmdList);
+
+// Result memoization prefix ("memo cmd ..."), see memo.c
+void run_memoized(CommandList *cmdList);
+
+// Metered pipelines ("meter cmd | ...", --meter), see meter.c
+extern int g_meter;
+int meter_begin(int count);
+int meter_link(int index, int fds[2]);
+void meter_end(int report);
+void run_metered(CommandList *cmdList);
+
+// Checkpoint and resume for batch runs (--checkpoint, --resume), see checkpoint.c
+extern int g_checkpoint;
+int checkpoint_open(const char *path, int resume);
+void checkpoint_begin(const char *line);
+void checkpoint_extend(const char *line);
+int checkpoint_completed(int *status);
+void checkpoint_end(int status);
+int checkpoint_changes_state(const char *command);
+void checkpoint_replay(const char *line);
+
+// Allocation accounting per subsystem ("mem"), see mem.c
+typedef enum MemTag {
+    MEM_PARSER,         // Command lists, tokens, redirections
+    MEM_EXEC,           // Resolved executable paths, pid arrays, the job table
+    MEM_HISTORY,        // History entries
+    MEM_PATH,           // The search path, lookup cache and completion index
+    MEM_SUBSYSTEMS
+} MemTag;
+typedef struct MemStats {
+    long long allocs;
+    long long live;
+    long long live_bytes;
+    long long peak_bytes;
+    long long total_bytes;
+} MemStats;
+void *mem_malloc(MemTag tag, size_t size);
+void *mem_calloc(MemTag tag, size_t count, size_t size);
+void *mem_realloc(MemTag tag, void *ptr, size_t size);
+char *mem_strdup(MemTag tag, const char *str);
+void mem_free(MemTag tag, void *ptr);
+const MemStats *mem_stats(MemTag tag);
+long mem_rss_kb(void);
+void builtin_mem(char **args);
 
 // Process a single command line (dispatch built-in vs. external commands)
 void process_line(char *line);
+void run_command_list(const char *line, CommandList *cmdList);
+void run_prefixed(CommandList *cmdList);
+
+// for/while/if blocks compiled to bytecode, see script.c
+int script_starts_block(const char *line);
+void script_run_block(const char *first_line, FILE *input, int interactive);
+ssize_t script_getline(char **line, size_t *cap, FILE *input);
+int script_pending(void);
 
 // Advanced parsing
 CommandList *parse_line_advanced(char *line);
+char *parse_word(const char *raw);
+char *list_separator(char *line);
+void free_command(Command *cmd);
 void free_command_list(CommandList *cmd_list);
+void command_shift_tokens(Command *cmd, int n);
 
 #endif // SHELL_H
@@ -0,0 +1,142 @@
+#include "shell.h"
+
+/* Resource accounting for reaped children.
+ *
+ * Every child reaped through wait_children() is recorded as one stage of
+ * g_last_job (used by the "time" prefix) and folded into session totals
+ * (reported by the "stats"/"times" builtin). The shell's own CPU use comes
+ * from getrusage(RUSAGE_SELF) so it is reported apart from its children.
+ */
+
+JobStats g_last_job = {0};
+
+// Session-wide totals over every reaped child
+static struct {
+    long commands;      // Lines dispatched by process_line()
+    long jobs;          // Foreground jobs waited on
+    long procs;         // Child processes reaped
+    long failed;        // Children with a non-zero status
+    double wall;        // Sum of per-job wall time
+    double user;
+    double sys;
+    long maxrss_kb;     // Largest child peak RSS
+    long nvcsw;
+    long nivcsw;
+    long inblock;
+    long oublock;
+} session;
+
+static double timeval_seconds(const struct timeval *tv) {
+    return tv->tv_sec + tv->tv_usec / 1e6;
+}
+
+void stats_from_reap(ProcStats *ps, const ReapResult *res) {
+    ps->pid = res->pid;
+    ps->status = res->timed_out ? TIMEOUT_STATUS : exit_status_code(res->status);
+    ps->wall = res->wall;
+    ps->user = timeval_seconds(&res->ru.ru_utime);
+    ps->sys = timeval_seconds(&res->ru.ru_stime);
+    ps->maxrss_kb = res->ru.ru_maxrss;
+    ps->nvcsw = res->ru.ru_nvcsw;
+    ps->nivcsw = res->ru.ru_nivcsw;
+    ps->inblock = res->ru.ru_inblock;
+    ps->oublock = res->ru.ru_oublock;
+}
+
+void stats_begin_job(int stages) {
+    memset(&g_last_job, 0, sizeof(g_last_job));
+    g_last_job.count = stages < MAX_JOB_STAGES ? stages : MAX_JOB_STAGES;
+}
+
+void stats_add_session(const ProcStats *ps) {
+    session.procs++;
+    if (ps->status != 0) session.failed++;
+    session.user += ps->user;
+    session.sys += ps->sys;
+    if (ps->maxrss_kb > session.maxrss_kb) session.maxrss_kb = ps->maxrss_kb;
+    session.nvcsw += ps->nvcsw;
+    session.nivcsw += ps->nivcsw;
+    session.inblock += ps->inblock;
+    session.oublock += ps->oublock;
+}
+
+// Record one pipeline stage (by position) and add it to the session.
+void stats_set_stage(int index, const ProcStats *ps) {
+    if (index >= 0 && index < g_last_job.count) {
+        g_last_job.stages[index] = *ps;
+    }
+    stats_add_session(ps);
+}
+
+void stats_end_job(double wall) {
+    g_last_job.wall = wall;
+    session.jobs++;
+    session.wall += wall;
+}
+
+void stats_count_command(void) {
+    session.commands++;
+}
+
+static void print_usage_line(const char *label, double wall, double user, double sys,
+                             long maxrss, long nvcsw, long nivcsw, long inblock, long oublock) {
+    fprintf(stderr,
+            "%s real %.3fs user %.3fs sys %.3fs maxrss %ldKB ctxsw %ld/%ld io %ld/%ld\n",
+            label, wall, user, sys, maxrss, nvcsw, nivcsw, inblock, oublock);
+}
+
+/* Print what "time" measured: one line per stage when the command was a
+ * pipeline, then the total. self_delta is the shell's own usage over the
+ * command, which is all there is for builtins.
+ */
+void print_job_stats(const JobStats *job, double wall, const struct rusage *self_delta) {
+    double user = 0, sys = 0;
+    long maxrss = 0, nvcsw = 0, nivcsw = 0, inblock = 0, oublock = 0;
+    char label[64];
+
+    for (int i = 0; i < job->count; i++) {
+        const ProcStats *ps = &job->stages[i];
+        if (job->count > 1) {
+            snprintf(label, sizeof(label), "  stage %d pid %d status %d:", i, ps->pid, ps->status);
+            print_usage_line(label, ps->wall, ps->user, ps->sys, ps->maxrss_kb,
+                             ps->nvcsw, ps->nivcsw, ps->inblock, ps->oublock);
+        }
+        user += ps->user;
+        sys += ps->sys;
+        if (ps->maxrss_kb > maxrss) maxrss = ps->maxrss_kb;
+        nvcsw += ps->nvcsw;
+        nivcsw += ps->nivcsw;
+        inblock += ps->inblock;
+        oublock += ps->oublock;
+    }
+    if (job->count == 0 && self_delta) {
+        user = timeval_seconds(&self_delta->ru_utime);
+        sys = timeval_seconds(&self_delta->ru_stime);
+        nvcsw = self_delta->ru_nvcsw;
+        nivcsw = self_delta->ru_nivcsw;
+        inblock = self_delta->ru_inblock;
+        oublock = self_delta->ru_oublock;
+    }
+    print_usage_line("time:", wall, user, sys, maxrss, nvcsw, nivcsw, inblock, oublock);
+}
+
+// stats / times: session summary, shell overhead reported separately
+void builtin_stats(char **args) {
+    if (args[1] != NULL) {
+        print_error();
+        return;
+    }
+    struct rusage self;
+    if (getrusage(RUSAGE_SELF, &self) != 0) {
+        print_error();
+        return;
+    }
+    printf("commands %ld jobs %ld processes %ld failed %ld\n",
+           session.commands, session.jobs, session.procs, session.failed);
+    printf("children: wall %.3fs user %.3fs sys %.3fs maxrss %ldKB ctxsw %ld/%ld io %ld/%ld\n",
+           session.wall, session.user, session.sys, session.maxrss_kb,
+           session.nvcsw, session.nivcsw, session.inblock, session.oublock);
+    printf("shell:    user %.3fs sys %.3fs maxrss %ldKB ctxsw %ld/%ld io %ld/%ld\n",
+           timeval_seconds(&self.ru_utime), timeval_seconds(&self.ru_stime), self.ru_maxrss,
+           self.ru_nvcsw, self.ru_nivcsw, self.ru_inblock, self.ru_oublock);
+}
@@ -0,0 +1,157 @@
+#include "shell.h"
+#include <sys/mman.h>
+#include <stdint.h>
+#include <pthread.h>
+
+/* Low-overhead runtime tracing.
+ *
+ * Events are fixed-size records written into a ring buffer with one
+ * atomic increment and no formatting or I/O. The ring lives in a shared
+ * anonymous mapping, so forked children record their exec events into the
+ * same buffer right up to execve(). "trace dump FILE" (or --trace FILE at
+ * exit) writes the ring as Chrome trace JSON for chrome://tracing or
+ * Perfetto, with one track per recording process. The recording pid is
+ * cached and refreshed by an atfork handler, so an event costs no system
+ * call beyond the clock read (a vDSO call).
+ */
+
+// Ring capacity in events; must be a power of two
+#define TRACE_CAPACITY (1 << 16)
+
+typedef struct TraceEvent {
+    uint64_t ts_ns;     // CLOCK_MONOTONIC timestamp
+    int32_t pid;        // Process that recorded the event
+    uint16_t type;      // TraceType
+    char phase;         // 'B' begin, 'E' end, 'i' instant
+    char pad;
+    int64_t arg;        // Event-specific value (pid, fd, status, ...)
+} TraceEvent;
+
+typedef struct TraceRing {
+    uint64_t head;      // Total events ever recorded
+    TraceEvent events[TRACE_CAPACITY];
+} TraceRing;
+
+static const char *trace_names[] = {
+    [TRACE_LINE] = "line",
+    [TRACE_PARSE] = "parse",
+    [TRACE_LOOKUP] = "lookup",
+    [TRACE_FORK] = "fork",
+    [TRACE_EXEC] = "exec",
+    [TRACE_PIPE] = "pipe",
+    [TRACE_WAIT] = "wait",
+    [TRACE_REAP] = "reap",
+    [TRACE_BUILTIN] = "builtin",
+};
+
+int g_trace_enabled = 0;
+
+static TraceRing *ring = NULL;
+static pid_t trace_owner = 0;
+static pid_t trace_pid = 0;     // getpid() of this process, kept across fork()
+static char *exit_dump_path = NULL;
+
+void trace_record(int type, char phase, long arg) {
+    if (!ring) return;
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    uint64_t slot = __atomic_fetch_add(&ring->head, 1, __ATOMIC_RELAXED);
+    TraceEvent *ev = &ring->events[slot & (TRACE_CAPACITY - 1)];
+    ev->ts_ns = (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+    ev->pid = (int32_t)trace_pid;
+    ev->type = (uint16_t)type;
+    ev->phase = phase;
+    ev->arg = arg;
+}
+
+static void trace_after_fork(void) {
+    trace_pid = getpid();
+}
+
+static int trace_start(void) {
+    if (!ring) {
+        ring = mmap(NULL, sizeof(TraceRing), PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        if (ring == MAP_FAILED) {
+            ring = NULL;
+            return -1;
+        }
+        trace_owner = trace_pid = getpid();
+        pthread_atfork(NULL, NULL, trace_after_fork);
+    }
+    g_trace_enabled = 1;
+    return 0;
+}
+
+// Write the ring, oldest event first, as Chrome trace JSON.
+static int trace_dump(const char *path) {
+    if (!ring) {
+        return -1;
+    }
+    FILE *out = fopen(path, "we");
+    if (!out) {
+        return -1;
+    }
+    uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    uint64_t first = head > TRACE_CAPACITY ? head - TRACE_CAPACITY : 0;
+
+    fprintf(out, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    for (uint64_t i = first; i < head; i++) {
+        const TraceEvent *ev = &ring->events[i & (TRACE_CAPACITY - 1)];
+        const char *name = ev->type < sizeof(trace_names) / sizeof(trace_names[0]) &&
+                           trace_names[ev->type] ? trace_names[ev->type] : "unknown";
+        fprintf(out,
+                "%s{\"name\":\"%s\",\"cat\":\"gush\",\"ph\":\"%c\",\"ts\":%.3f,"
+                "\"pid\":%d,\"tid\":%d,%s\"args\":{\"arg\":%ld}}",
+                i == first ? "" : ",\n", name, ev->phase, ev->ts_ns / 1000.0,
+                (int)trace_owner, (int)ev->pid, ev->phase == 'i' ? "\"s\":\"t\"," : "",
+                (long)ev->arg);
+    }
+    fprintf(out, "\n]}\n");
+    return fclose(out) == 0 ? 0 : -1;
+}
+
+static void trace_exit_dump(void) {
+    if (exit_dump_path && ring && getpid() == trace_owner) {
+        trace_dump(exit_dump_path);
+    }
+}
+
+// --trace FILE: record from startup and dump when the shell exits.
+int trace_enable_at_exit(const char *path) {
+    if (trace_start() < 0) {
+        return -1;
+    }
+    exit_dump_path = strdup(path);
+    if (!exit_dump_path) {
+        return -1;
+    }
+    atexit(trace_exit_dump);
+    return 0;
+}
+
+// trace [on | off | clear | dump FILE]
+void builtin_trace(char **args) {
+    if (args[1] == NULL) {
+        uint64_t head = ring ? ring->head : 0;
+        printf("trace %s, %llu events recorded, %d buffered\n",
+               g_trace_enabled ? "on" : "off", (unsigned long long)head,
+               (int)(head < TRACE_CAPACITY ? head : TRACE_CAPACITY));
+    } else if (strcmp(args[1], "on") == 0 && args[2] == NULL) {
+        if (trace_start() < 0) {
+            print_error();
+        }
+    } else if (strcmp(args[1], "off") == 0 && args[2] == NULL) {
+        g_trace_enabled = 0;
+    } else if (strcmp(args[1], "clear") == 0 && args[2] == NULL) {
+        if (ring) {
+            ring->head = 0;
+        }
+    } else if (strcmp(args[1], "dump") == 0 && args[2] != NULL && args[3] == NULL) {
+        if (trace_dump(args[2]) < 0) {
+            print_error();
+        }
+    } else {
+        print_error();
+    }
+}
@@ -1,9 +1,35 @@
 #include "shell.h"
 
+int g_last_status = 0;
+
+// Every shell error goes through here, so it also marks the command failed.
 void print_error() {
+    g_last_status = 1;
     write(STDERR_FILENO, ERROR_MSG, strlen(ERROR_MSG));
 }
 
 void debug_print(const char *msg) {
     write(STDERR_FILENO, msg, strlen(msg));
-}
\ No newline at end of file
+}
+
+// Monotonic clock in seconds, used for latency measurements
+double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int compare_doubles(const void *a, const void *b) {
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+// Nearest-rank percentile over an already sorted array (p in 0..100)
+double percentile(const double *sorted, int n, double p) {
+    if (n <= 0) return 0.0;
+    int rank = (int)(p / 100.0 * n + 0.999999);
+    if (rank < 1) rank = 1;
+    if (rank > n) rank = n;
+    return sorted[rank - 1];
+}
@@ -0,0 +1,649 @@
+#include "shell.h"
+#include <spawn.h>
+
+/* bench.c - Microbenchmarks for gush (run with make bench)
+ *
+ * Links against the shell's own objects (everything but main.o) and times
+ * the hot paths directly: parsing, executable lookup, process spawning,
+ * pipeline throughput, the in-shell filters against coreutils, command
+ * completion over 20000 binaries and an end-to-end batch run of ./gush. Each
+ * benchmark is repeated and the median kept, then compared against a
+ * baseline file so regressions stand out; any regression makes the exit
+ * status 1.
+ *
+ * With -m it runs a long-session soak instead (make soak): a million mixed
+ * command lines through process_line(), failing if live allocations or RSS
+ * grow once the session is warm.
+ *
+ * Usage: bench_gush [-b baseline_file] [-s] [-r reps] [-m [lines]]
+ *   -b FILE  baseline to compare against (default tests/bench_baseline.txt)
+ *   -s       save this run as the new baseline
+ *   -r N     repetitions per benchmark (default 5)
+ *   -m [N]   soak over N command lines (default 1000000) and exit
+ */
+
+extern char **environ;
+
+// Normally defined in main.c, which the benchmark replaces
+char **g_path = NULL;
+int g_path_count = 0;
+
+#define MAX_BENCHES 32
+#define DEFAULT_REPS 5
+#define REGRESSION_PCT 10.0
+
+typedef struct BenchResult {
+    const char *name;
+    const char *unit;
+    double value;           // Median over repetitions
+    int higher_is_better;
+    double baseline;        // 0 when no baseline entry exists
+} BenchResult;
+
+static BenchResult results[MAX_BENCHES];
+static int result_count = 0;
+static int reps = DEFAULT_REPS;
+
+static void setup_path(void) {
+    static char *dirs[] = {"/bin", "/usr/bin", "/usr/local/bin", "/sbin", "/usr/sbin"};
+    g_path_count = sizeof(dirs) / sizeof(dirs[0]);
+    g_path = mem_malloc(MEM_PATH, sizeof(char*) * g_path_count);
+    for (int i = 0; i < g_path_count; i++) {
+        g_path[i] = mem_strdup(MEM_PATH, dirs[i]);
+    }
+}
+
+// Run fn reps times (after one warmup) and record the median.
+static void run_bench(const char *name, const char *unit, int higher_is_better,
+                      double (*fn)(void)) {
+    double *samples = malloc(sizeof(double) * reps);
+    if (!samples) {
+        perror("bench_gush");
+        exit(2);
+    }
+    fn();
+    for (int i = 0; i < reps; i++) {
+        samples[i] = fn();
+    }
+    qsort(samples, reps, sizeof(double), compare_doubles);
+    BenchResult *r = &results[result_count++];
+    r->name = name;
+    r->unit = unit;
+    r->value = percentile(samples, reps, 50);
+    free(samples);
+    r->higher_is_better = higher_is_better;
+    r->baseline = 0;
+    fprintf(stderr, "  %-22s done\n", name);
+}
+
+// ------------------------
+// Parser
+// ------------------------
+
+static double parse_rate(const char *input, int iterations) {
+    char line[MAX_LINE];
+    double start = now_seconds();
+    for (int i = 0; i < iterations; i++) {
+        snprintf(line, sizeof(line), "%s", input);
+        CommandList *cl = parse_line_advanced(line);
+        free_command_list(cl);
+    }
+    return iterations / (now_seconds() - start);
+}
+
+static double bench_parse_simple(void) {
+    return parse_rate("ls -l /tmp", 200000);
+}
+
+static double bench_parse_pipeline(void) {
+    return parse_rate("cat < in.txt | grep -i foo | sort -r | uniq -c | head -n 10 > out.txt", 100000);
+}
+
+static double bench_parse_long(void) {
+    static char line[MAX_LINE];
+    if (!line[0]) {
+        size_t off = snprintf(line, sizeof(line), "echo");
+        for (int i = 0; i < 100 && off < sizeof(line) - 16; i++) {
+            off += snprintf(line + off, sizeof(line) - off, i % 3 ? " arg%d" : " 'q%d'", i);
+        }
+    }
+    return parse_rate(line, 20000);
+}
+
+// ------------------------
+// Executable lookup
+// ------------------------
+
+// Names of real executables in /usr/bin, looked up once each for "cold".
+static char **lookup_names = NULL;
+static int lookup_count = 0;
+
+static void collect_lookup_names(void) {
+    FILE *fp = popen("ls /usr/bin 2>/dev/null | head -n 400", "r");
+    char buf[256];
+    lookup_names = malloc(sizeof(char*) * 400);
+    while (fp && lookup_count < 400 && fgets(buf, sizeof(buf), fp)) {
+        buf[strcspn(buf, "\n")] = '\0';
+        lookup_names[lookup_count++] = strdup(buf);
+    }
+    if (fp) pclose(fp);
+}
+
+static double bench_lookup_cold(void) {
+    // Every name is looked up once per sample, with the lookup cache emptied
+    // first, so each one walks the path directories.
+    lookup_cache_invalidate();
+    double start = now_seconds();
+    for (int i = 0; i < lookup_count; i++) {
+        mem_free(MEM_EXEC, search_executable(lookup_names[i]));
+    }
+    return (now_seconds() - start) / (lookup_count ? lookup_count : 1) * 1e6;
+}
+
+// The same names again, each now answered from the lookup cache.
+static double bench_lookup_cached(void) {
+    double start = now_seconds();
+    for (int i = 0; i < lookup_count; i++) {
+        mem_free(MEM_EXEC, search_executable(lookup_names[i]));
+    }
+    return (now_seconds() - start) / (lookup_count ? lookup_count : 1) * 1e6;
+}
+
+static double bench_lookup_warm(void) {
+    const int iterations = 50000;
+    double start = now_seconds();
+    for (int i = 0; i < iterations; i++) {
+        mem_free(MEM_EXEC, search_executable("sort"));
+    }
+    return (now_seconds() - start) / iterations * 1e6;
+}
+
+static double bench_lookup_miss(void) {
+    const int iterations = 50000;
+    double start = now_seconds();
+    for (int i = 0; i < iterations; i++) {
+        mem_free(MEM_EXEC, search_executable("gush-no-such-command"));
+    }
+    return (now_seconds() - start) / iterations * 1e6;
+}
+
+// ------------------------
+// Spawning and pipelines
+// ------------------------
+
+static double bench_spawn(void) {
+    char *args[] = {"true", NULL};
+    const int iterations = 300;
+    double start = now_seconds();
+    for (int i = 0; i < iterations; i++) {
+        execute_external(args, 0, NULL, NULL, NULL, 0);
+    }
+    return iterations / (now_seconds() - start);
+}
+
+// Build a throwaway Command from a NULL-terminated token list.
+static Command *make_command(const char **tokens, const char *output_file) {
+    Command *cmd = mem_calloc(MEM_PARSER, 1, sizeof(Command));
+    cmd->tokens = mem_malloc(MEM_PARSER, sizeof(char*) * MAX_ARGS);
+    for (cmd->token_count = 0; tokens[cmd->token_count]; cmd->token_count++) {
+        cmd->tokens[cmd->token_count] = mem_strdup(MEM_PARSER, tokens[cmd->token_count]);
+    }
+    cmd->tokens[cmd->token_count] = NULL;
+    cmd->output_file = output_file ? mem_strdup(MEM_PARSER, output_file) : NULL;
+    return cmd;
+}
+
+#define PIPE_BYTES (256L * 1024 * 1024)
+
+// head -c 256M /dev/zero | cat | ... | cat > /dev/null, reported in MB/s
+static double pipeline_throughput(int stages) {
+    CommandList list;
+    Command *cmds[16];
+    char size_arg[32];
+    snprintf(size_arg, sizeof(size_arg), "%ld", PIPE_BYTES);
+    const char *producer[] = {"head", "-c", size_arg, "/dev/zero", NULL};
+    const char *relay[] = {"cat", NULL};
+
+    cmds[0] = make_command(producer, NULL);
+    for (int i = 1; i < stages; i++) {
+        cmds[i] = make_command(relay, i == stages - 1 ? "/dev/null" : NULL);
+    }
+    list.commands = cmds;
+    list.count = stages;
+
+    double start = now_seconds();
+    execute_pipeline(list.commands, list.count, 0);
+    double elapsed = now_seconds() - start;
+
+    for (int i = 0; i < stages; i++) {
+        free_command(cmds[i]);
+    }
+    return PIPE_BYTES / (1024.0 * 1024.0) / elapsed;
+}
+
+static double bench_pipeline_2(void) {
+    return pipeline_throughput(2);
+}
+
+static double bench_pipeline_4(void) {
+    return pipeline_throughput(4);
+}
+
+// ------------------------
+// In-shell filters vs coreutils
+// ------------------------
+
+#define TEXT_LINES 1000000
+static char text_path[] = "/tmp/gush-bench-text-XXXXXX";
+static char out_path[] = "/tmp/gush-bench-out-XXXXXX";
+static double text_mb = 0;
+
+// ps-like text: about 60 MB, "sbin" on every 7th line.
+static void write_text_file(void) {
+    int fd = mkstemp(text_path);
+    FILE *fp = fdopen(fd, "w");
+    for (int i = 0; i < TEXT_LINES; i++) {
+        fprintf(fp, "root %7d  0.0  0.1 %8d %6d ?  Ss  10:00  0:00 /usr/%s/daemon-%d\n",
+                i, 100000 + i, 5000 + i % 977, i % 7 ? "lib" : "sbin", i % 13);
+    }
+    text_mb = ftell(fp) / (1024.0 * 1024.0);
+    fclose(fp);
+    close(mkstemp(out_path));
+}
+
+/* Time "cat text | FILTER > file" with the filters on or off. Not
+ * /dev/null: GNU grep notices that and stops at the first match.
+ */
+static double filter_pipeline(const char **filter, int builtin) {
+    const char *producer[] = {"cat", text_path, NULL};
+    Command *cmds[2] = {make_command(producer, NULL), make_command(filter, out_path)};
+
+    g_filters_enabled = builtin;
+    double start = now_seconds();
+    execute_pipeline(cmds, 2, 0);
+    double elapsed = now_seconds() - start;
+    g_filters_enabled = 1;
+
+    free_command(cmds[0]);
+    free_command(cmds[1]);
+    return elapsed;
+}
+
+static const char *wc_l[] = {"wc", "-l", NULL};
+static const char *grep_f[] = {"grep", "-F", "sbin", NULL};
+static const char *head_n[] = {"head", "-n", "10", NULL};
+
+static double bench_wc_builtin(void) {
+    return text_mb / filter_pipeline(wc_l, 1);
+}
+
+static double bench_wc_coreutils(void) {
+    return text_mb / filter_pipeline(wc_l, 0);
+}
+
+static double bench_grep_builtin(void) {
+    return text_mb / filter_pipeline(grep_f, 1);
+}
+
+static double bench_grep_coreutils(void) {
+    return text_mb / filter_pipeline(grep_f, 0);
+}
+
+// head stops the producer early, so this is latency rather than throughput.
+static double bench_head_builtin(void) {
+    return filter_pipeline(head_n, 1) * 1e6;
+}
+
+static double bench_head_coreutils(void) {
+    return filter_pipeline(head_n, 0) * 1e6;
+}
+
+// ------------------------
+// Command completion
+// ------------------------
+
+#define COMPLETE_BINARIES 20000
+static char complete_dir[] = "/tmp/gush-bench-bin-XXXXXX";
+
+// A PATH directory of empty executables with shared prefixes ("ab-tool-17").
+static void make_complete_dir(void) {
+    char file[256];
+    mkdtemp(complete_dir);
+    for (int i = 0; i < COMPLETE_BINARIES; i++) {
+        snprintf(file, sizeof(file), "%s/%c%c-tool-%d", complete_dir,
+                 'a' + i % 26, 'a' + i / 26 % 26, i);
+        close(open(file, O_WRONLY | O_CREAT | O_CLOEXEC, 0755));
+    }
+}
+
+static void remove_complete_dir(void) {
+    char file[256];
+    for (int i = 0; i < COMPLETE_BINARIES; i++) {
+        snprintf(file, sizeof(file), "%s/%c%c-tool-%d", complete_dir,
+                 'a' + i % 26, 'a' + i / 26 % 26, i);
+        unlink(file);
+    }
+    rmdir(complete_dir);
+}
+
+// Index the directory from scratch (dropping it from the path first).
+static double bench_complete_build(void) {
+    char **saved = g_path;
+    int saved_count = g_path_count;
+    char *dirs[] = {complete_dir};
+    g_path_count = 0;
+    complete_refresh();
+    g_path = dirs;
+    g_path_count = 1;
+    double start = now_seconds();
+    complete_refresh();
+    double elapsed = now_seconds() - start;
+    g_path = saved;
+    g_path_count = saved_count;
+    return elapsed * 1e3;
+}
+
+// One Tab press: the refresh check plus a prefix with ~30 matches.
+static double bench_complete_lookup(void) {
+    char **saved = g_path;
+    int saved_count = g_path_count;
+    char *dirs[] = {complete_dir};
+    char common[256];
+    const int iterations = 100000;
+    g_path = dirs;
+    g_path_count = 1;
+    double start = now_seconds();
+    for (int i = 0; i < iterations; i++) {
+        complete_refresh();
+        complete_command("qa", common, sizeof(common), NULL, 0);
+    }
+    double elapsed = now_seconds() - start;
+    g_path = saved;
+    g_path_count = saved_count;
+    return elapsed / iterations * 1e6;
+}
+
+// ------------------------
+// End-to-end batch run
+// ------------------------
+
+#define BATCH_LINES 10000
+static char batch_path[] = "/tmp/gush-bench-XXXXXX";
+
+// Mostly builtins, with an external command (/bin/true, since "true" is a
+// builtin) every 50 lines.
+static void write_batch_script(void) {
+    int fd = mkstemp(batch_path);
+    FILE *fp = fdopen(fd, "w");
+    for (int i = 0; i < BATCH_LINES; i++) {
+        switch (i % 5) {
+        case 0: fprintf(fp, "# comment %d\n", i); break;
+        case 1: fprintf(fp, "cd /tmp\n"); break;
+        case 2: fprintf(fp, "path /bin /usr/bin /usr/local/bin\n"); break;
+        case 3: fprintf(fp, i % 50 == 3 ? "/bin/true\n" : "cd .\n"); break;
+        default: fprintf(fp, "pwd\n"); break;
+        }
+    }
+    fclose(fp);
+}
+
+static double bench_batch(void) {
+    char *argv[] = {"./gush", batch_path, NULL};
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, "/dev/null", O_WRONLY, 0);
+
+    double start = now_seconds();
+    pid_t pid;
+    int status = 0;
+    if (posix_spawn(&pid, "./gush", &actions, NULL, argv, environ) != 0) {
+        fprintf(stderr, "bench: cannot run ./gush (build it first)\n");
+        exit(1);
+    }
+    waitpid(pid, &status, 0);
+    double elapsed = now_seconds() - start;
+    posix_spawn_file_actions_destroy(&actions);
+    return BATCH_LINES / elapsed;
+}
+
+// ------------------------
+// Long-session soak
+// ------------------------
+
+#define SOAK_DEFAULT_LINES 1000000
+#define SOAK_EXTERNAL_EVERY 1000
+#define SOAK_RSS_SLACK_KB 1024
+
+// Cycled through: builtins, quoting, directory changes and lines that fail
+static const char *soak_lines[] = {
+    "cd /tmp",
+    "pwd",
+    "cd .",
+    "path /bin /usr/bin /usr/local/bin",
+    "true; false; :",
+    "test -d /tmp",
+    "[ -f /etc/passwd ]",
+    "pushd /",
+    "dirs",
+    "popd",
+    "history",
+    "stats",
+    ": \"quoted arg\" 'single' esc\\ aped $HOME",
+    "true <",
+    "true 3>&x",
+    "cd /gush/no/such/dir",
+    "test -n x > /dev/null",
+    "mem",
+};
+
+// Every SOAK_EXTERNAL_EVERY lines, one of these instead
+static const char *soak_externals[] = {
+    "/bin/true",
+    "ls /tmp | wc -l",
+    "echo soak | cat > /dev/null",
+    "/bin/true &",
+};
+
+/* Let background jobs finish and be reaped the way every line reaps them,
+ * without the jobs builtin, so a table that keeps finished jobs shows up
+ * as growth.
+ */
+static void soak_settle(void) {
+    usleep(20000);
+    jobs_reap();
+}
+
+static void soak_snapshot(MemStats *stats, long *rss_kb) {
+    soak_settle();
+    for (int t = 0; t < MEM_SUBSYSTEMS; t++) {
+        stats[t] = *mem_stats(t);
+    }
+    *rss_kb = mem_rss_kb();
+}
+
+/* Run lines command lines through the shell as one long session, with
+ * output discarded. Live allocations and RSS are taken after the first
+ * tenth (so caches and the history ring are full) and again at the end.
+ * Any growth in a subsystem's live count, or RSS growth beyond
+ * SOAK_RSS_SLACK_KB, fails the run.
+ */
+static int soak(long lines) {
+    static const char *names[MEM_SUBSYSTEMS] = {"parser", "exec", "history", "path"};
+    int nlines = sizeof(soak_lines) / sizeof(soak_lines[0]);
+    int nexternal = sizeof(soak_externals) / sizeof(soak_externals[0]);
+    long warmup = lines / 10;
+    MemStats before[MEM_SUBSYSTEMS], after[MEM_SUBSYSTEMS];
+    long rss_before = 0, rss_after = 0;
+    char line[256];
+
+    fprintf(stderr, "Soak: %ld lines (%ld warmup)...\n", lines, warmup);
+    fflush(stdout);
+    int saved_out = dup(STDOUT_FILENO);
+    int saved_err = dup(STDERR_FILENO);
+    int null_fd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+    dup2(null_fd, STDOUT_FILENO);
+    dup2(null_fd, STDERR_FILENO);
+    close(null_fd);
+
+    double start = now_seconds();
+    for (long i = 0; i < lines; i++) {
+        const char *text = soak_lines[i % nlines];
+        if (i % SOAK_EXTERNAL_EVERY == SOAK_EXTERNAL_EVERY - 1) {
+            text = soak_externals[i / SOAK_EXTERNAL_EVERY % nexternal];
+        }
+        snprintf(line, sizeof(line), "%s", text);
+        if (strncmp(line, "history", 7) != 0) {
+            add_history(line);
+        }
+        process_line(line);
+        if (i + 1 == warmup) {
+            soak_snapshot(before, &rss_before);
+        }
+    }
+    double elapsed = now_seconds() - start;
+    soak_snapshot(after, &rss_after);
+
+    fflush(stdout);
+    dup2(saved_out, STDOUT_FILENO);
+    dup2(saved_err, STDERR_FILENO);
+    close(saved_out);
+    close(saved_err);
+
+    int failed = 0;
+    printf("\n%ld lines in %.1fs (%.0f lines/s)\n\n", lines, elapsed, lines / elapsed);
+    printf("%-12s %12s %12s %10s\n", "live", "warmup", "end", "change");
+    for (int t = 0; t < MEM_SUBSYSTEMS; t++) {
+        int grew = after[t].live > before[t].live;
+        failed |= grew;
+        printf("%-12s %12lld %12lld %+10lld%s\n", names[t], before[t].live, after[t].live,
+               after[t].live - before[t].live, grew ? "  LEAK" : "");
+    }
+    int rss_grew = rss_after - rss_before > SOAK_RSS_SLACK_KB;
+    failed |= rss_grew;
+    printf("%-12s %12ld %12ld %+10ld%s\n", "rss KB", rss_before, rss_after,
+           rss_after - rss_before, rss_grew ? "  GROWTH" : "");
+    printf("\nsoak %s\n", failed ? "FAILED" : "passed");
+    return failed;
+}
+
+// ------------------------
+// Baseline handling and report
+// ------------------------
+
+static void load_baseline(const char *path) {
+    FILE *fp = fopen(path, "r");
+    char name[64];
+    double value;
+    if (!fp) return;
+    while (fscanf(fp, "%63s %lf", name, &value) == 2) {
+        for (int i = 0; i < result_count; i++) {
+            if (strcmp(results[i].name, name) == 0) {
+                results[i].baseline = value;
+            }
+        }
+    }
+    fclose(fp);
+}
+
+static void save_baseline(const char *path) {
+    FILE *fp = fopen(path, "w");
+    if (!fp) {
+        perror(path);
+        return;
+    }
+    for (int i = 0; i < result_count; i++) {
+        fprintf(fp, "%s %.6f\n", results[i].name, results[i].value);
+    }
+    fclose(fp);
+    printf("Baseline saved to %s\n", path);
+}
+
+static int print_report(void) {
+    int regressions = 0;
+    printf("\n%-22s %14s %-8s %14s %9s\n", "benchmark", "median", "unit", "baseline", "change");
+    printf("%-22s %14s %-8s %14s %9s\n", "---------", "------", "----", "--------", "------");
+    for (int i = 0; i < result_count; i++) {
+        BenchResult *r = &results[i];
+        if (r->baseline > 0) {
+            double change = (r->value - r->baseline) / r->baseline * 100.0;
+            double worse = r->higher_is_better ? -change : change;
+            int regressed = worse > REGRESSION_PCT;
+            regressions += regressed;
+            printf("%-22s %14.2f %-8s %14.2f %+8.1f%%%s\n", r->name, r->value, r->unit,
+                   r->baseline, change, regressed ? "  REGRESSION" : "");
+        } else {
+            printf("%-22s %14.2f %-8s %14s %9s\n", r->name, r->value, r->unit, "-", "-");
+        }
+    }
+    return regressions;
+}
+
+int main(int argc, char *argv[]) {
+    const char *baseline = "tests/bench_baseline.txt";
+    int save = 0;
+    long soak_lines_count = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-b") == 0 && i + 1 < argc) {
+            baseline = argv[++i];
+        } else if (strcmp(argv[i], "-s") == 0) {
+            save = 1;
+        } else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+            reps = atoi(argv[++i]);
+            if (reps < 1) reps = 1;
+        } else if (strcmp(argv[i], "-m") == 0) {
+            soak_lines_count = i + 1 < argc && argv[i + 1][0] != '-' ? atol(argv[++i])
+                                                                    : SOAK_DEFAULT_LINES;
+            if (soak_lines_count < 10) soak_lines_count = 10;
+        } else {
+            fprintf(stderr, "usage: %s [-b baseline_file] [-s] [-r reps] [-m [lines]]\n",
+                    argv[0]);
+            return 2;
+        }
+    }
+
+    setup_path();
+    if (soak_lines_count > 0) {
+        return soak(soak_lines_count);
+    }
+    collect_lookup_names();
+    write_batch_script();
+    write_text_file();
+    make_complete_dir();
+
+    fprintf(stderr, "Running benchmarks (%d reps each)...\n", reps);
+    run_bench("parse_simple", "ops/s", 1, bench_parse_simple);
+    run_bench("parse_pipeline", "ops/s", 1, bench_parse_pipeline);
+    run_bench("parse_long_100arg", "ops/s", 1, bench_parse_long);
+    run_bench("lookup_cold", "us/op", 0, bench_lookup_cold);
+    run_bench("lookup_cached", "us/op", 0, bench_lookup_cached);
+    run_bench("lookup_warm", "us/op", 0, bench_lookup_warm);
+    run_bench("lookup_miss", "us/op", 0, bench_lookup_miss);
+    run_bench("spawn_external", "spawn/s", 1, bench_spawn);
+    run_bench("pipeline_2_stage", "MB/s", 1, bench_pipeline_2);
+    run_bench("pipeline_4_stage", "MB/s", 1, bench_pipeline_4);
+    run_bench("wc_l_builtin", "MB/s", 1, bench_wc_builtin);
+    run_bench("wc_l_coreutils", "MB/s", 1, bench_wc_coreutils);
+    run_bench("grep_F_builtin", "MB/s", 1, bench_grep_builtin);
+    run_bench("grep_F_coreutils", "MB/s", 1, bench_grep_coreutils);
+    run_bench("head_n_builtin", "us/op", 0, bench_head_builtin);
+    run_bench("head_n_coreutils", "us/op", 0, bench_head_coreutils);
+    run_bench("complete_index_20k", "ms", 0, bench_complete_build);
+    run_bench("complete_lookup", "us/op", 0, bench_complete_lookup);
+    run_bench("batch_10k_lines", "lines/s", 1, bench_batch);
+    remove_complete_dir();
+    unlink(batch_path);
+    unlink(text_path);
+    unlink(out_path);
+
+    load_baseline(baseline);
+    int regressions = print_report();
+    if (save) {
+        save_baseline(baseline);
+    } else if (regressions) {
+        printf("\n%d benchmark(s) regressed by more than %.0f%% against %s\n",
+               regressions, REGRESSION_PCT, baseline);
+        return 1;
+    }
+    return 0;
+}
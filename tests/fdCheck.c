@@ -0,0 +1,52 @@
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/* Report any descriptor above 2 that this process inherited, other than
+ * the ones named as arguments, and any named one that is missing. Used by
+ * run_tests.sh to check that gush leaks no fds into its children and keeps
+ * the ones a redirection asks for ("./fdCheck 3 3> file").
+ */
+int main(int argc, char *argv[]) {
+    int expected[16];
+    int nexpected = 0;
+    for (int i = 1; i < argc && nexpected < 16; i++) {
+        expected[nexpected++] = atoi(argv[i]);
+    }
+    DIR *dir = opendir("/proc/self/fd");
+    if (!dir) {
+        perror("fdCheck");
+        return 2;
+    }
+    int leaked = 0;
+    struct dirent *ent;
+    while ((ent = readdir(dir)) != NULL) {
+        if (ent->d_name[0] == '.') continue;
+        int fd = atoi(ent->d_name);
+        if (fd <= 2 || fd == dirfd(dir)) continue;
+        int wanted = 0;
+        for (int i = 0; i < nexpected; i++) {
+            if (expected[i] == fd) wanted = 1;
+        }
+        if (wanted) continue;
+        char link[64], target[256];
+        snprintf(link, sizeof(link), "/proc/self/fd/%d", fd);
+        ssize_t n = readlink(link, target, sizeof(target) - 1);
+        target[n > 0 ? n : 0] = '\0';
+        fprintf(stderr, "fdCheck: leaked fd %d -> %s\n", fd, target);
+        leaked = 1;
+    }
+    closedir(dir);
+    for (int i = 0; i < nexpected; i++) {
+        if (fcntl(expected[i], F_GETFD) < 0) {
+            fprintf(stderr, "fdCheck: missing fd %d\n", expected[i]);
+            leaked = 1;
+        }
+    }
+    if (!leaked) {
+        fprintf(stderr, "fdCheck: ok\n");
+    }
+    return leaked;
+}
@@ -1,6 +1,8 @@
 #!/bin/bash
 # run_tests.sh - Test suite for the gush shell
 
+cd "$(dirname "$0")" || exit 1
+
 echo "========== Testing Built-In Commands =========="
 echo "pwd" | ../gush > output_pwd.txt
 echo "cd /" | ../gush > output_cd.txt
@@ -17,4 +19,284 @@ echo "Background wasteTime PID: $bg_pid"
 echo "========== Testing Batch Mode =========="
 ../gush twoDir.txt > output_batch.txt
 
+echo "========== Testing Failed Redirections =========="
+# A child that cannot open its target must not rewind the batch file.
+../gush redirFail.txt > output_redirfail.txt 2>&1
+if [ "$(grep -c "^z$" output_redirfail.txt)" -eq 1 ] && [ "$(grep -c "^y$" output_redirfail.txt)" -eq 1 ]; then
+    echo "PASS: each line after a failed redirection ran once"
+else
+    echo "FAIL: failed redirection (see output_redirfail.txt)"
+fi
+
+echo "========== Testing Redirection Operators =========="
+# >, >>, 2>, 2>&1, &> and N> each reach the right file; a malformed
+# operator drops its command with an error and the next line still runs.
+rm -rf output_redirOps
+mkdir output_redirOps
+../gush redirOps.txt > output_redirops.txt 2>&1
+if [ "$(cat output_redirOps/out)" = "$(printf 'one\ntwo')" ] \
+    && grep -q "No such file" output_redirOps/err && grep -q "No such file" output_redirOps/both \
+    && grep -q "No such file" output_redirOps/amp && [ -f output_redirOps/fd3 ] && [ ! -s output_redirOps/fd3 ] \
+    && grep -q "An error has occurred" output_redirops.txt && ! grep -q "bad" output_redirops.txt \
+    && grep -q "^after$" output_redirops.txt; then
+    echo "PASS: every redirection operator wrote where it should"
+else
+    echo "FAIL: redirection operators (see output_redirops.txt and output_redirOps/)"
+fi
+rm -rf output_redirOps
+
+echo "========== Testing Script Blocks =========="
+# for/while/if, break/continue, one-line blocks, quoted and expanded for
+# lists, and an unterminated block at the end whose following line must
+# still run.
+../gush blockScript.txt > output_blocks.txt 2>&1
+expected="for a
+for b
+for c
+loop 1
+loop 3
+loop 4
+while once
+elif taken
+else taken
+inline one
+inline two
+after inline
+quoted [a b]
+quoted [c]
+nested 11
+nested 1x
+nested 22
+nested 2x
+An error has occurred
+after open block"
+if [ "$(cat output_blocks.txt)" = "$expected" ]; then
+    echo "PASS: script blocks ran as written and an open block kept the next line"
+else
+    echo "FAIL: script blocks (see output_blocks.txt)"
+fi
+
+echo "========== Testing Coprocesses and Jobs =========="
+# A request/reply round trip through a coprocess, jobs while it and a
+# background job run, and the killed job reported once and dropped.
+../gush coprocJobs.txt > output_coproc.txt 2>&1
+if [ "$(grep -c "^got-ping$" output_coproc.txt)" -eq 1 ] \
+    && [ "$(grep -Ec "^\[1\] [0-9]+ +Running +coproc up$" output_coproc.txt)" -eq 2 ] \
+    && [ "$(grep -Ec "^\[2\] [0-9]+ +Running +sleep 5$" output_coproc.txt)" -eq 1 ] \
+    && [ "$(grep -Ec "^\[2\] [0-9]+ +Exit 143 +sleep 5$" output_coproc.txt)" -eq 1 ] \
+    && [ "$(tail -n 1 output_coproc.txt)" = "end" ]; then
+    echo "PASS: the coprocess answered and jobs listed the table"
+else
+    echo "FAIL: coprocess and jobs (see output_coproc.txt)"
+fi
+
+echo "========== Testing Descriptor Leaks =========="
+# Every child should hold only fds 0-2, even with the batch file, a JSON
+# log and pipeline ends open in the shell; "3> /dev/null" must keep fd 3.
+if ! cc -o fdCheck fdCheck.c; then
+    echo "FAIL: could not build fdCheck"
+else
+    ../gush --log-json /dev/null fdCheck.txt 2> output_fd.txt
+    ok=$(grep -c "^fdCheck: ok$" output_fd.txt)
+    if grep -q "leaked\|missing" output_fd.txt || [ "$ok" -ne 13 ]; then
+        echo "FAIL: $ok of 13 children had exactly the fds they should (see output_fd.txt)"
+    else
+        echo "PASS: $ok children held only fds 0-2, plus fd 3 where redirected"
+    fi
+fi
+
+echo "========== Testing Loadable Builtins =========="
+cc -shared -fPIC -I../src -o sampleBuiltin.so sampleBuiltin.c
+echo -e "enable -f ./sampleBuiltin.so joinargs\njoinargs a b c\nenable -d joinargs\njoinargs a" \
+    | ../gush > output_builtin.txt 2>&1
+if grep -q "a,b,c" output_builtin.txt && grep -q "An error has occurred" output_builtin.txt; then
+    echo "PASS: joinargs ran in-process and was unloaded"
+else
+    echo "FAIL: loadable builtin (see output_builtin.txt)"
+fi
+
+echo "========== Testing Metered Pipelines =========="
+# 1..1000 with newlines is 3893 bytes; wc must still see every line
+echo -e "meter seq 1 1000 | cat | wc -l" | ../gush > output_meter.txt 2>&1
+if grep -q "> 1000$" output_meter.txt && grep -q "pipe 0->1: 3893 bytes" output_meter.txt \
+    && grep -q "pipe 1->2: 3893 bytes" output_meter.txt; then
+    echo "PASS: both relays moved every byte"
+else
+    echo "FAIL: metered pipeline (see output_meter.txt)"
+fi
+
+echo "========== Testing In-Shell Filters =========="
+# A wc found before the system one must run, and with no path there is no wc.
+mkdir -p output_filterDir
+printf '#!/bin/sh\necho local wc\n' > output_filterDir/wc
+chmod +x output_filterDir/wc
+echo -e "echo hi | wc -l\ncd output_filterDir\necho hi | wc -l\ncd ..\npath\nwc -l < run_tests.sh" \
+    | ../gush > output_filters.txt 2>&1
+rm -rf output_filterDir
+if [ "$(grep -Ec "> [0-9]+$" output_filters.txt)" -eq 1 ] && grep -q "> 1$" output_filters.txt \
+    && grep -q "> local wc$" output_filters.txt && grep -q "An error has occurred" output_filters.txt; then
+    echo "PASS: filters replaced only the system wc"
+else
+    echo "FAIL: in-shell filters (see output_filters.txt)"
+fi
+# An empty last line in a read must still count, as with GNU grep.
+printf 'a\n\n' > output_filterInput.txt
+echo -e "cat output_filterInput.txt | grep -cv x\ncat output_filterInput.txt | grep -v x | wc -l" \
+    | ../gush > output_filters.txt 2>&1
+rm -f output_filterInput.txt
+if [ "$(grep -c "> 2$" output_filters.txt)" -eq 2 ]; then
+    echo "PASS: grep kept the empty last line"
+else
+    echo "FAIL: grep with an empty last line (see output_filters.txt)"
+fi
+
+echo "========== Testing Memoization =========="
+# The second run is a hit; rewriting the input file makes the third a miss.
+rm -rf output_memoDir
+printf 'a\n' > output_memoInput.txt
+echo -e "memo cat < output_memoInput.txt\nmemo cat < output_memoInput.txt\nmemo --stats\necho changed > output_memoInput.txt\nmemo cat < output_memoInput.txt\nmemo --stats" \
+    | GUSH_MEMO_DIR=output_memoDir ../gush > output_memo.txt 2>&1
+rm -rf output_memoDir output_memoInput.txt
+if [ "$(grep -Ec "(^|> )a$" output_memo.txt)" -eq 2 ] && grep -q "1 hits, 1 misses" output_memo.txt \
+    && grep -q "> changed$" output_memo.txt && grep -q "1 hits, 2 misses" output_memo.txt; then
+    echo "PASS: memo replayed the unchanged run and reran after the input changed"
+else
+    echo "FAIL: memoization (see output_memo.txt)"
+fi
+
+echo "========== Testing Checkpoint and Resume =========="
+# Keep the first two records as if the run had died after "echo first";
+# the resumed run must redo only the rest, with the cd replayed.
+../gush --checkpoint output_checkpoint.ckpt checkpointScript.txt > /dev/null 2>&1
+head -n 2 output_checkpoint.ckpt > output_checkpoint.tmp
+mv output_checkpoint.tmp output_checkpoint.ckpt
+../gush --checkpoint output_checkpoint.ckpt --resume checkpointScript.txt > output_checkpoint.txt 2>&1
+if ! grep -q "^first$" output_checkpoint.txt && grep -q "^second$" output_checkpoint.txt \
+    && grep -q "tests/testDir$" output_checkpoint.txt; then
+    echo "PASS: resumed after the last recorded line with the cd replayed"
+else
+    echo "FAIL: checkpoint resume (see output_checkpoint.txt)"
+fi
+# The same with the directory entered by pushd, which must be replayed too.
+../gush --checkpoint output_checkpoint.ckpt checkpointPushd.txt > /dev/null 2>&1
+head -n 2 output_checkpoint.ckpt > output_checkpoint.tmp
+mv output_checkpoint.tmp output_checkpoint.ckpt
+../gush --checkpoint output_checkpoint.ckpt --resume checkpointPushd.txt > output_checkpoint.txt 2>&1
+if ! grep -q "^first$" output_checkpoint.txt && grep -q "^second$" output_checkpoint.txt \
+    && grep -q "tests/testDir/A$" output_checkpoint.txt; then
+    echo "PASS: resumed after the last recorded line with the pushd replayed"
+else
+    echo "FAIL: checkpoint resume after pushd (see output_checkpoint.txt)"
+fi
+# A skipped list replays its cd; a skipped block holding a cd runs again.
+../gush --checkpoint output_checkpoint.ckpt checkpointLists.txt > /dev/null 2>&1
+head -n 2 output_checkpoint.ckpt > output_checkpoint.tmp
+mv output_checkpoint.tmp output_checkpoint.ckpt
+../gush --checkpoint output_checkpoint.ckpt --resume checkpointLists.txt > output_checkpoint.txt 2>&1
+if ! grep -q "^first$" output_checkpoint.txt && grep -q "^in A$" output_checkpoint.txt \
+    && grep -q "^second$" output_checkpoint.txt && grep -q "tests/testDir/A$" output_checkpoint.txt; then
+    echo "PASS: resumed with the cd of a list replayed and the block rerun"
+else
+    echo "FAIL: checkpoint resume after a list and a block (see output_checkpoint.txt)"
+fi
+
+echo "========== Testing Directory Stack =========="
+echo -e "pushd testDir/A\npushd ../B\npopd\npwd\npopd\npwd\npopd" | ../gush > output_dirs.txt 2>&1
+if grep -q "> $PWD/testDir/A$" output_dirs.txt && grep -q "> $PWD$" output_dirs.txt \
+    && grep -q "An error has occurred" output_dirs.txt; then
+    echo "PASS: pushd/popd returned through the stack and stopped when it was empty"
+else
+    echo "FAIL: directory stack (see output_dirs.txt)"
+fi
+
+echo "========== Testing Memory Accounting =========="
+echo -e "pwd\npwd\ncd .\nmem" | ../gush > output_mem.txt 2>&1
+if grep -Eq "history +[0-9]+ +4 " output_mem.txt && grep -q "^rss: " output_mem.txt; then
+    echo "PASS: mem counted the four history entries and reported RSS"
+else
+    echo "FAIL: memory accounting (see output_mem.txt)"
+fi
+
+echo "========== Testing Timeouts =========="
+# A command stopped by timeout exits with 124; the JSON log records it.
+rm -f output_timeout.json
+echo "timeout 0.2 sleep 5" > output_timeout.txt
+../gush --log-json output_timeout.json output_timeout.txt > /dev/null 2>&1
+if grep -q '"cmd":"timeout 0.2 sleep 5".*"status":124' output_timeout.json; then
+    echo "PASS: the timed-out command exited with 124"
+else
+    echo "FAIL: timeout (see output_timeout.json)"
+fi
+
+echo "========== Testing Resource Limits =========="
+# dd writes 16 KB under a 1 KB file size limit and dies from SIGXFSZ.
+echo "ulimit -f 1 dd if=/dev/zero of=output_limit.tmp bs=4096 count=4" | ../gush > output_limits.txt 2>&1
+rm -f output_limit.tmp
+if grep -q "killed by .*file size (kbytes) limit (ulimit -f)" output_limits.txt; then
+    echo "PASS: the file size limit was named when dd was killed"
+else
+    echo "FAIL: resource limits (see output_limits.txt)"
+fi
+
+echo "========== Testing CPU Affinity =========="
+# The child's own /proc entry shows the mask sched set before exec.
+echo "sched -c 0 grep Cpus_allowed_list /proc/self/status" | ../gush > output_sched.txt 2>&1
+if grep -Eq "Cpus_allowed_list:[[:space:]]+0$" output_sched.txt; then
+    echo "PASS: sched -c 0 pinned the child to CPU 0"
+else
+    echo "FAIL: sched affinity (see output_sched.txt)"
+fi
+
+echo "========== Testing Parallel Fan-Out =========="
+# Each job prints two lines around a sleep of its input in tenths of a
+# second, and input 2 fails. Output must come out one job at a time in
+# the order the jobs finish, with the failure counted.
+printf '#!/bin/sh\necho "start $1"\nsleep 0.$1\necho "end $1"\n[ "$1" != 2 ]\n' > output_parallelJob.sh
+chmod +x output_parallelJob.sh
+echo "parallel -j 3 ./output_parallelJob.sh ::: 3 1 2" | ../gush > output_parallel.txt 2>&1
+rm -f output_parallelJob.sh
+if [ "$(grep -E "^(gush> )?(start|end) " output_parallel.txt | sed 's/^gush> //' | tr '\n' ' ')" \
+        = "start 1 end 1 start 2 end 2 start 3 end 3 " ] \
+    && grep -q "parallel: 3 jobs, 1 failed" output_parallel.txt; then
+    echo "PASS: parallel grouped each job's output and counted the failure"
+else
+    echo "FAIL: parallel (see output_parallel.txt)"
+fi
+
+echo "========== Testing Command Server =========="
+# The daemon's socket is private; a client's stdout is passed to the
+# command, and the command's exit status comes back as the client's.
+rm -f output_server.sock
+../gush --serve output_server.sock &
+server_pid=$!
+for _ in $(seq 50); do
+    [ -S output_server.sock ] && break
+    sleep 0.1
+done
+../gush --client output_server.sock echo hello > output_client.txt 2>&1
+echo "echo piped" | ../gush --client output_server.sock >> output_client.txt 2>&1
+../gush --client output_server.sock false
+client_status=$?
+sock_mode=$(stat -c %a output_server.sock 2>/dev/null)
+kill "$server_pid"
+wait "$server_pid" 2>/dev/null
+rm -f output_server.sock
+if [ "$(cat output_client.txt)" = "$(printf 'hello\npiped')" ] && [ "$client_status" -eq 1 ] \
+    && [ "$sock_mode" = "600" ]; then
+    echo "PASS: the client ran echo through the daemon's 0600 socket"
+else
+    echo "FAIL: command server (see output_client.txt; status $client_status, mode $sock_mode)"
+fi
+
+echo "========== Testing Benchmarks =========="
+# Quoted commands reach process_line() whole, pipes and lists included.
+echo -e "bench -n 2 -w 0 --show-output 'echo a | wc -l' ::: 'echo x; echo y'\nbench -n 1 -w 0 --json - 'echo a\tb'" \
+    | ../gush > output_bench.txt 2>&1
+if [ "$(grep -c "^y$" output_bench.txt)" -eq 2 ] && grep -q "^Benchmark: echo a | wc -l$" output_bench.txt \
+    && grep -q '"command":"echo a\\tb"' output_bench.txt; then
+    echo "PASS: bench ran a quoted pipeline and list and escaped the JSON"
+else
+    echo "FAIL: bench (see output_bench.txt)"
+fi
+
 echo "Tests completed. Please review the output_*.txt files for results."
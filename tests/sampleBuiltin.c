@@ -0,0 +1,19 @@
+#include <stdio.h>
+#include "gush_builtin.h"
+
+/* A native builtin for run_tests.sh to load with "enable -f". Prints its
+ * arguments joined by commas and fails when given none.
+ */
+static int joinargs(int argc, char **argv) {
+    if (argc < 2) {
+        return 1;
+    }
+    for (int i = 1; i < argc; i++) {
+        printf("%s%s", argv[i], i + 1 < argc ? "," : "\n");
+    }
+    return 0;
+}
+
+const struct gush_builtin gush_builtin_joinargs = {
+    GUSH_BUILTIN_ABI, "joinargs", joinargs, "joinargs WORD ..."
+};
@@ -12,6 +12,12 @@ int main() {
         "ls -l > output.txt",
         "ps aux | grep sbin | wc -l",
         "ls -l | grep Joy > out.txt",
+        "make >> build.log 2>&1",
+        "ls / /missing &> all.txt",
+        "cat big 3>:prealloc=1G,nocache copy.bin",
+        "grep 1999 message.txt",
+        "sleep 5000 2>err.txt",
+        "ls /missing 2>>err.txt 1>out.txt",
         NULL
     };
 
@@ -37,6 +43,13 @@ int main() {
                 printf("  Input redirection file: %s\n", cmd->input_file);
             if (cmd->output_file)
                 printf("  Output redirection file: %s\n", cmd->output_file);
+            for (int r = 0; r < cmd->redir_count; r++) {
+                Redirect *rd = &cmd->redirs[r];
+                if (rd->dup_from >= 0)
+                    printf("  Redirect: %d>&%d\n", rd->fd, rd->dup_from);
+                else
+                    printf("  Redirect: %d%s %s\n", rd->fd, rd->append ? ">>" : ">", rd->path);
+            }
             printf("  Tokens (%d):\n", cmd->token_count);
             for (int k = 0; k < cmd->token_count; k++) {
                 printf("    token[%d]: %s\n", k, cmd->tokens[k]);